@@ -0,0 +1,54 @@
+#!/bin/sh
+# Generate a synthetic project shaped like a large story: objects arranged
+# in a tree of rooms with several properties each, and functions that read
+# properties, print text, and call one another. The string literals are
+# spread across the functions. Used with the builder's -time-report option
+# to measure how each phase of the build scales with the size of a project.
+#
+# USAGE: ./gen_project.sh [objects] [functions] [strings] > project.ratc
+
+OBJECTS=${1:-10000}
+FUNCTIONS=${2:-50000}
+STRINGS=${3:-200000}
+
+awk -v objects="$OBJECTS" -v functions="$FUNCTIONS" -v strings="$STRINGS" 'BEGIN {
+    print "declare TITLE   \"Project Benchmark\";"
+    print "declare AUTHOR  \"Generated\";"
+    print "declare VERSION 1;"
+    print "declare GAMEID  \"PROJECT-BENCHMARK\";"
+    print ""
+    for (i = 0; i < objects; ++i) {
+        if (i % 20 == 0) {
+            printf "object obj%d\n", i
+        } else {
+            printf "object obj%d @obj%d\n", i, i - i % 20
+        }
+        printf "    $name \"object %d\"\n", i
+        printf "    $weight %d\n", i % 50
+        printf "    $kind $kind%d\n", i % 100
+        printf "    $noun `noun%d`\n", i % 1000
+        print  ";"
+    }
+    print ""
+    perFunction = int((strings - objects) / functions)
+    if (perFunction < 1) perFunction = 1
+    for (f = 0; f < functions; ++f) {
+        printf "function func%d( base ) {\n", f
+        print  "    [ total ]"
+        printf "    (set total (add base (get obj%d $weight)))\n", f % objects
+        for (s = 0; s < perFunction; ++s) {
+            printf "    (print \"function %d says %d.\")\n", f, s
+        }
+        if (f + 1 < functions && f % 10 != 9) {
+            printf "    (set total (func%d total))\n", f + 1
+        }
+        print  "    (return total)"
+        print  "}"
+    }
+    print ""
+    print "function main() {"
+    for (f = 0; f < functions; f += 10) {
+        printf "    (func%d 0)\n", f
+    }
+    print "}"
+}'
@@ -0,0 +1,30 @@
+#!/bin/sh
+# Generate a synthetic story with a large number of objects, each with its
+# own property, string literal, and vocabulary word, and with a handful of
+# literals repeated throughout. Used to measure how the builder scales with
+# the size of the string, property, and vocab pools.
+#
+# USAGE: ./gen_strings.sh [object count] > strings.ratc
+
+COUNT=${1:-50000}
+
+awk -v count="$COUNT" 'BEGIN {
+    print "declare TITLE   \"String Benchmark\";"
+    print "declare AUTHOR  \"Generated\";"
+    print "declare VERSION 1;"
+    print "declare GAMEID  \"STRING-BENCHMARK\";"
+    print ""
+    for (i = 0; i < count; ++i) {
+        printf "object obj%d $prop%d \"text   for object %d\" $name \"shared name\" $word `word%d`;\n", i, i, i, i
+    }
+    print ""
+    printf "declare allObjects ["
+    for (i = 0; i < count; ++i) {
+        printf " obj%d", i
+    }
+    print " ];"
+    print ""
+    print "function main() {"
+    print "    (size allObjects)"
+    print "}"
+}'
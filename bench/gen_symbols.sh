@@ -0,0 +1,34 @@
+#!/bin/sh
+# Generate a synthetic story that declares a large number of symbols and
+# refers to each of them from function bodies. Used to measure how the
+# builder scales with the size of the symbol table.
+#
+# USAGE: ./gen_symbols.sh [symbol count] > symbols.ratc
+
+COUNT=${1:-100000}
+
+awk -v count="$COUNT" 'BEGIN {
+    print "declare TITLE   \"Symbol Benchmark\";"
+    print "declare AUTHOR  \"Generated\";"
+    print "declare VERSION 1;"
+    print "declare GAMEID  \"SYMBOL-BENCHMARK\";"
+    print ""
+    for (i = 0; i < count; ++i) {
+        printf "declare sym%d %d;\n", i, i
+    }
+    print ""
+    for (f = 0; f * 100 < count; ++f) {
+        printf "function func%d(total) {\n", f
+        for (i = f * 100; i < count && i < (f + 1) * 100; ++i) {
+            printf "    (set total (add total sym%d))\n", i
+        }
+        print "    (return total)"
+        print "}"
+    }
+    print ""
+    print "function main() {"
+    for (f = 0; f * 100 < count; ++f) {
+        printf "    (func%d 0)\n", f
+    }
+    print "}"
+}'
@@ -0,0 +1,58 @@
+#!/bin/sh
+# Build each benchmark workload, run it a number of times, and report the
+# median, fastest, and slowest wall time of each along with the spread
+# between the fastest and slowest run as a percentage of the median. The
+# times are those reported by the runner's -replay option, so they cover
+# only running the game and not loading it. The output format is kept
+# stable so results can be compared between versions.
+#
+# USAGE: ./run_bench.sh [runs] [workload...]
+#
+# The builder and runner used can be changed with the BUILD and RUNNER
+# environment variables, and extra options for the builder (such as -O)
+# given in BUILD_FLAGS.
+
+RUNS=${1:-5}
+[ $# -gt 0 ] && shift
+WORKLOADS=${*:-"calls properties lists maps text tokenize objtree gc dice"}
+BUILD=${BUILD:-../build}
+RUNNER=${RUNNER:-../run}
+
+echo "# runs: $RUNS  build flags: ${BUILD_FLAGS:-none}"
+printf "%-12s %12s %10s %10s %10s %8s\n" \
+    "workload" "instructions" "median_ms" "min_ms" "max_ms" "spread%"
+
+STATUS=0
+for NAME in $WORKLOADS; do
+    if ! BUILD_OUTPUT=$($BUILD $BUILD_FLAGS "$NAME.ratc" -o "$NAME.rvm" 2>&1); then
+        echo "$BUILD_OUTPUT" >&2
+        echo "$NAME: build failed" >&2
+        STATUS=1
+        continue
+    fi
+
+    TIMES=""
+    RUN=0
+    while [ $RUN -lt "$RUNS" ]; do
+        if ! OUTPUT=$($RUNNER "$NAME.rvm" -replay /dev/null); then
+            echo "$NAME: run failed" >&2
+            STATUS=1
+            break
+        fi
+        INSTRUCTIONS=$(echo "$OUTPUT" | awk '/instructions executed:/ { print $3 }')
+        TIMES="$TIMES $(echo "$OUTPUT" | awk '/wall time:/ { print $3 }')"
+        RUN=$((RUN + 1))
+    done
+    [ $RUN -lt "$RUNS" ] && continue
+
+    echo $TIMES | tr ' ' '\n' | sort -n | awk -v name="$NAME" -v count="$INSTRUCTIONS" '
+        { times[NR] = $1 }
+        END {
+            if (NR % 2) median = times[(NR + 1) / 2]
+            else        median = (times[NR / 2] + times[NR / 2 + 1]) / 2
+            spread = median > 0 ? (times[NR] - times[1]) / median * 100 : 0
+            printf "%-12s %12d %10.2f %10.2f %10.2f %8.1f\n", \
+                name, count, median, times[1], times[NR], spread
+        }'
+done
+exit $STATUS
@@ -8,21 +8,52 @@
  * **************************************************************************/
 
 #include <chrono>
+#include <cstdlib>
 #include <cstring>
 #include <iomanip>
 #include <iostream>
 #include <fstream>
+#include <memory>
+#include <sstream>
 #include <string>
+#include <thread>
 #include <vector>
 
+#if defined(__linux__) || (defined(__APPLE__) && defined(__MACH__))
+#include <sys/resource.h>
+#endif
+
 #include "gamedata.h"
 #include "build.h"
 #include "builderror.h"
+#include "cache.h"
 #include "token.h"
 
 const char ansiEscape = 0x1B;
 
+// The time taken by each phase of the build, displayed with -time-report.
+class PhaseTimer {
+public:
+    typedef std::chrono::steady_clock Clock;
+
+    PhaseTimer()
+    : phaseStart(Clock::now())
+    { }
+    // the phase in progress, called name, has finished
+    void endPhase(const char *name) {
+        Clock::time_point now = Clock::now();
+        phases.push_back(std::make_pair(name, now - phaseStart));
+        phaseStart = now;
+    }
+    void write(std::ostream &out) const;
+
+private:
+    std::vector<std::pair<const char*, Clock::duration> > phases;
+    Clock::time_point phaseStart;
+};
+
 void dump_errors(GameData &gamedata, bool useAnsiEscapes);
+void dump_timeReport(const PhaseTimer &timer, const GameData &gamedata, size_t tokenCount);
 
 int main(int argc, char *argv[]) {
     std::vector<std::string> sourceFiles;
@@ -40,6 +71,11 @@ int main(int argc, char *argv[]) {
     bool useAnsiEscapes = true;
     bool showFiles = false;
     bool showNextIdent = false;
+    bool optimize = false;
+    bool timeReport = false;
+    std::string cacheDirectory;
+    int threadCount = std::thread::hardware_concurrency();
+    if (threadCount < 1) threadCount = 1;
 
     auto runStart = std::chrono::system_clock::now();
 
@@ -65,6 +101,8 @@ int main(int argc, char *argv[]) {
             dump_objTree = true;
         } else if (strcmp(argv[i], "-skip-ident-check") == 0) {
             skipIdentCheck = true;
+        } else if (strcmp(argv[i], "-O") == 0) {
+            optimize = true;
 
         } else if (strcmp(argv[i], "-color") == 0) {
             useAnsiEscapes = true;
@@ -74,6 +112,8 @@ int main(int argc, char *argv[]) {
             showFiles = true;
         } else if (strcmp(argv[i], "-show-next-ident") == 0) {
             showNextIdent = true;
+        } else if (strcmp(argv[i], "-time-report") == 0) {
+            timeReport = true;
 
         } else if (strcmp(argv[i], "-o") == 0) {
             ++i;
@@ -82,6 +122,19 @@ int main(int argc, char *argv[]) {
                 return 1;
             }
             outputFile = argv[i];
+        } else if (strcmp(argv[i], "-cache") == 0) {
+            ++i;
+            if (i >= argc) {
+                std::cerr << "-cache argument requires name of cache directory.\n";
+                return 1;
+            }
+            cacheDirectory = argv[i];
+        } else if (strcmp(argv[i], "-threads") == 0) {
+            ++i;
+            if (i >= argc || (threadCount = strtol(argv[i], nullptr, 10)) <= 0) {
+                std::cerr << "-threads requires a positive number of threads.\n";
+                return 1;
+            }
         } else if (argv[i][0] == '-') {
             std::cerr << "Unrecognized argument " << argv[i] << ".\n";
             return 1;
@@ -100,28 +153,60 @@ int main(int argc, char *argv[]) {
     GameData gamedata;
     add_default_constants(gamedata);
 
+    std::unique_ptr<BuildCache> cache;
+    if (!cacheDirectory.empty()) {
+        std::stringstream settings;
+        settings << skipIdentCheck << optimize;
+        cache.reset(new BuildCache(cacheDirectory, argv[0], sourceFiles, settings.str()));
+    }
+    bool dumping = dump_tokens || dump_data || dump_bytecode || dump_functionHeaders
+                || dump_strings || dump_asmCode || dump_irFlag || dump_objTree;
+    if (cache && !dumping && cache->isUpToDate(outputFile, gamedata, nextIdent)) {
+        if (showNextIdent && !skipIdentCheck) {
+            std::cerr << "[next available ident: " << nextIdent << "]\n";
+        }
+        if (!gamedata.errors.empty()) {
+            dump_errors(gamedata, useAnsiEscapes);
+        }
+        if (useAnsiEscapes) std::cerr << ansiEscape << "[92m";
+        std::cerr << "[Gamefile " << outputFile << " is up to date.]\n";
+        if (useAnsiEscapes) std::cerr << ansiEscape << "[0m";
+        return 0;
+    }
+
+    PhaseTimer timer;
     try {
-        for (const std::string &file : sourceFiles) {
-            if (showFiles) {
+        if (showFiles) {
+            for (const std::string &file : sourceFiles) {
                 std::cerr << "[including file " << file << ".]\n";
             }
-            std::vector<Token> newTokens = lex_file(gamedata, file);
-            tokens.insert(tokens.end(), newTokens.begin(), newTokens.end());
         }
+        tokens = lex_files(gamedata, sourceFiles, threadCount, cache.get());
+        timer.endPhase("lex");
         if (gamedata.hasErrors()) { dump_errors(gamedata, useAnsiEscapes); return 1; }
         gamedata.sortVocab();
+        timer.endPhase("sortVocab");
         parse_tokens(gamedata, tokens);
+        timer.endPhase("parse_tokens");
         if (gamedata.hasErrors()) { dump_errors(gamedata, useAnsiEscapes); return 1; }
         translate_symbols(gamedata);
+        timer.endPhase("translate_symbols");
         if (gamedata.hasErrors()) { dump_errors(gamedata, useAnsiEscapes); return 1; }
         gamedata.organize();
+        timer.endPhase("organize");
         if (!skipIdentCheck) {
             nextIdent = gamedata.checkObjectIdents();
+            timer.endPhase("checkObjectIdents");
         }
         if (gamedata.hasErrors()) { dump_errors(gamedata, useAnsiEscapes); return 1; }
-        parse_functions(gamedata);
+        // the asm and ir dumps need the intermediate code, which isn't kept
+        // for cached functions
+        parse_functions(gamedata, threadCount, optimize,
+                        dump_asmCode || dump_irFlag ? nullptr : cache.get());
+        timer.endPhase("parse_functions");
         if (gamedata.hasErrors()) { dump_errors(gamedata, useAnsiEscapes); return 1; }
         generate(gamedata, outputFile);
+        timer.endPhase("generate");
         if (gamedata.hasErrors()) { dump_errors(gamedata, useAnsiEscapes); return 1; }
     } catch (BuildError &e) {
         std::cerr << "Error: " << e.getMessage() << '\n';
@@ -164,6 +249,7 @@ int main(int argc, char *argv[]) {
         std::ofstream objtreeFile("objtree.dot");
         dump_objtree(gamedata, objtreeFile);
     }
+    if (dumping) timer.endPhase("dumps");
 
     gamedata.symbols.markUsed("TITLE");
     gamedata.symbols.markUsed("AUTHOR");
@@ -179,6 +265,14 @@ int main(int argc, char *argv[]) {
     if (!gamedata.errors.empty()) {
         dump_errors(gamedata, useAnsiEscapes);
     }
+    timer.endPhase("unused symbols");
+    if (cache && !gamedata.hasErrors()) {
+        cache->saveBuild(outputFile, gamedata, nextIdent);
+        timer.endPhase("saveBuild");
+    }
+    if (timeReport) {
+        dump_timeReport(timer, gamedata, tokens.size());
+    }
     if (!gamedata.hasErrors()) {
         auto runEnd = std::chrono::system_clock::now();
         auto buildTimeRaw = std::chrono::duration_cast<std::chrono::milliseconds>(runEnd - runStart);
@@ -224,4 +318,47 @@ void dump_errors(GameData &gamedata, bool useAnsiEscapes) {
         if (warnCount > 1) std::cerr << 's';
     }
     std::cerr << " occured.]\n";
-}
\ No newline at end of file
+}
+void PhaseTimer::write(std::ostream &out) const {
+    Clock::duration total(0);
+    for (const auto &phase : phases) total += phase.second;
+    double totalMS = std::chrono::duration<double, std::milli>(total).count();
+
+    std::ios_base::fmtflags oldFlags = out.flags();
+    std::streamsize oldPrecision = out.precision();
+    out << std::fixed << std::setprecision(3);
+    for (const auto &phase : phases) {
+        double phaseMS = std::chrono::duration<double, std::milli>(phase.second).count();
+        out << "    " << std::left << std::setw(20) << phase.first << std::right;
+        out << std::setw(12) << phaseMS << " ms";
+        out << std::setprecision(1) << std::setw(8);
+        out << (totalMS > 0 ? phaseMS / totalMS * 100 : 0) << "%\n";
+        out << std::setprecision(3);
+    }
+    out << "    " << std::left << std::setw(20) << "total" << std::right;
+    out << std::setw(12) << totalMS << " ms\n";
+    out.flags(oldFlags);
+    out.precision(oldPrecision);
+}
+
+void dump_timeReport(const PhaseTimer &timer, const GameData &gamedata, size_t tokenCount) {
+    std::cerr << "[build time report]\n";
+    timer.write(std::cerr);
+    std::cerr << "    tokens:             " << tokenCount << '\n';
+    std::cerr << "    symbols:            " << gamedata.symbols.symbols.size() << '\n';
+    std::cerr << "    strings:            " << gamedata.stringTable.size() << '\n';
+    std::cerr << "    objects:            " << gamedata.objects.size() << '\n';
+    std::cerr << "    functions:          " << gamedata.functions.size() << '\n';
+    std::cerr << "    vocab:              " << gamedata.vocab.size() << '\n';
+#if defined(__linux__) || (defined(__APPLE__) && defined(__MACH__))
+    struct rusage usage;
+    if (getrusage(RUSAGE_SELF, &usage) == 0) {
+#if defined(__APPLE__)
+        long peakKB = usage.ru_maxrss / 1024;   // reported in bytes
+#else
+        long peakKB = usage.ru_maxrss;          // reported in kilobytes
+#endif
+        std::cerr << "    peak memory:        " << peakKB << " KB\n";
+    }
+#endif
+}
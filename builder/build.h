@@ -4,16 +4,21 @@
 #include <string>
 #include <vector>
 
+class BuildCache;
+struct FunctionDef;
 class Token;
 class GameData;
 
 std::vector<Token> lex_file(GameData &gamedata, const std::string &filename);
+std::vector<Token> lex_files(GameData &gamedata, const std::vector<std::string> &filenames,
+                             int threadCount, BuildCache *cache);
 std::vector<Token> lex_string(GameData &gamedata, const std::string &source_name, const std::string &text);
 void preprocess_tokens(GameData &gamedata, std::vector<Token> &tokens);
 int parse_tokens(GameData &gamedata, const std::vector<Token> &tokens);
 void add_default_constants(GameData &gamedata);
 void translate_symbols(GameData &gamedata);
-int parse_functions(GameData &gamedata);
+int parse_functions(GameData &gamedata, int threadCount, bool optimize, BuildCache *cache);
+void optimize_function(FunctionDef *function);
 void generate(GameData &gamedata, const std::string &outputFile);
 
 std::string readFile(const std::string &file);
@@ -0,0 +1,400 @@
+#include <cstdio>
+#include <fstream>
+#include <iomanip>
+#include <sstream>
+#include <string>
+#include <sys/stat.h>
+#include <vector>
+
+#include "cache.h"
+#include "gamedata.h"
+#include "token.h"
+
+const uint32_t CACHE_FILETYPE_ID = 0x43525442;
+const uint32_t CACHE_VERSION = 1;
+
+enum CacheFileType {
+    BuildRecord, TokenList, FunctionList
+};
+
+void Hasher::add(const void *data, size_t length) {
+    const uint8_t *bytes = static_cast<const uint8_t*>(data);
+    uint64_t hash = mHash;
+    for (size_t i = 0; i < length; ++i) {
+        hash ^= bytes[i];
+        hash *= 1099511628211ULL;
+    }
+    mHash = hash;
+}
+
+void Hasher::add(const std::string &text) {
+    add_32(text.size());
+    add(text.data(), text.size());
+}
+
+void Hasher::add_32(uint32_t value) {
+    add(&value, sizeof(value));
+}
+
+void Hasher::add_64(uint64_t value) {
+    add(&value, sizeof(value));
+}
+
+uint64_t hashText(const std::string &text) {
+    Hasher hasher;
+    hasher.add(text.data(), text.size());
+    return hasher.hash();
+}
+
+struct CacheError {
+};
+
+class CacheReader {
+public:
+    CacheReader(const std::string &data)
+    : data(data), pos(0)
+    { }
+
+    uint8_t read_8() {
+        need(1);
+        return data[pos++];
+    }
+    uint32_t read_32() {
+        need(4);
+        uint32_t value = 0;
+        for (int i = 0; i < 4; ++i) {
+            value |= static_cast<uint32_t>(static_cast<uint8_t>(data[pos++])) << (i * 8);
+        }
+        return value;
+    }
+    uint64_t read_64() {
+        uint64_t low = read_32();
+        uint64_t high = read_32();
+        return low | (high << 32);
+    }
+    std::string read_str() {
+        uint32_t length = read_32();
+        need(length);
+        std::string text = data.substr(pos, length);
+        pos += length;
+        return text;
+    }
+    ErrorMsg read_error() {
+        ErrorMsg msg;
+        msg.type = static_cast<ErrorMsg::Type>(read_8());
+        std::string file = read_str();
+        int line = read_32();
+        int column = read_32();
+        msg.origin = Origin(file, line, column);
+        msg.message = read_str();
+        return msg;
+    }
+    void read_header(CacheFileType type, const std::string &builderId) {
+        if (read_32() != CACHE_FILETYPE_ID || read_32() != CACHE_VERSION
+                || read_8() != type || read_str() != builderId) {
+            throw CacheError();
+        }
+    }
+private:
+    void need(size_t count) {
+        if (pos + count > data.size()) throw CacheError();
+    }
+
+    const std::string &data;
+    size_t pos;
+};
+
+class CacheWriter {
+public:
+    void write_8(uint8_t value) {
+        data.push_back(value);
+    }
+    void write_32(uint32_t value) {
+        char bytes[4] = {
+            static_cast<char>(value & 0xFF),         static_cast<char>((value >> 8) & 0xFF),
+            static_cast<char>((value >> 16) & 0xFF), static_cast<char>((value >> 24) & 0xFF)
+        };
+        data.append(bytes, 4);
+    }
+    void write_64(uint64_t value) {
+        write_32(value & 0xFFFFFFFF);
+        write_32(value >> 32);
+    }
+    void write_str(const std::string &text) {
+        write_32(text.size());
+        data.append(text);
+    }
+    void write_error(const ErrorMsg &msg) {
+        write_8(msg.type);
+        write_str(msg.origin.file());
+        write_32(msg.origin.line);
+        write_32(msg.origin.column);
+        write_str(msg.message);
+    }
+    void write_header(CacheFileType type, const std::string &builderId) {
+        write_32(CACHE_FILETYPE_ID);
+        write_32(CACHE_VERSION);
+        write_8(type);
+        write_str(builderId);
+    }
+
+    std::string data;
+};
+
+static bool readCacheFile(const std::string &filename, std::string &content) {
+    std::ifstream inf(filename, std::ios_base::binary);
+    if (!inf) return false;
+    std::stringstream buffer;
+    buffer << inf.rdbuf();
+    content = buffer.str();
+    return true;
+}
+
+// Write to a temporary file first so an interrupted build never leaves a
+// partly written cache file behind.
+static void writeCacheFile(const std::string &filename, const CacheWriter &writer) {
+    std::string tempName = filename + ".tmp";
+    {
+        std::ofstream out(tempName, std::ios_base::binary);
+        if (!out) return;
+        out.write(writer.data.data(), writer.data.size());
+        if (!out) return;
+    }
+    std::rename(tempName.c_str(), filename.c_str());
+}
+
+
+BuildCache::BuildCache(const std::string &directory, const std::string &builderPath,
+                       const std::vector<std::string> &sourceFiles, const std::string &settings)
+: mDirectory(directory), mSourceFiles(sourceFiles), mSettings(settings),
+  mSourceHashes(sourceFiles.size(), 0)
+{
+    mkdir(mDirectory.c_str(), 0777);
+
+    // results are only reused by the same builder executable, since any
+    // change to the builder may change the code it generates
+    struct stat info;
+    if (stat("/proc/self/exe", &info) == 0 || stat(builderPath.c_str(), &info) == 0) {
+        std::stringstream id;
+        id << info.st_size << ' ' << info.st_mtime;
+        mBuilderId = id.str();
+    }
+}
+
+std::string BuildCache::pathFor(const std::string &name) const {
+    return mDirectory + "/" + name;
+}
+
+// Each source file has one token cache file, replaced when the file changes.
+std::string BuildCache::tokenCachePath(const std::string &filename) const {
+    std::stringstream name;
+    name << "tokens-" << std::hex << std::setfill('0') << std::setw(16);
+    name << hashText(filename) << ".cache";
+    return pathFor(name.str());
+}
+
+uint64_t BuildCache::buildKey() const {
+    Hasher hasher;
+    hasher.add(mSettings);
+    hasher.add_32(mSourceFiles.size());
+    for (unsigned i = 0; i < mSourceFiles.size(); ++i) {
+        hasher.add(mSourceFiles[i]);
+        hasher.add_64(mSourceHashes[i]);
+    }
+    return hasher.hash();
+}
+
+bool BuildCache::isUpToDate(const std::string &outputFile, GameData &gamedata, int &nextIdent) {
+    std::string content;
+    for (unsigned i = 0; i < mSourceFiles.size(); ++i) {
+        // missing files are reported when they're lexed
+        if (!readCacheFile(mSourceFiles[i], content)) return false;
+        mSourceHashes[i] = hashText(content);
+    }
+    if (!readCacheFile(pathFor("build.cache"), content)) return false;
+
+    try {
+        CacheReader in(content);
+        in.read_header(BuildRecord, mBuilderId);
+        if (in.read_64() != buildKey()) return false;
+        if (in.read_str() != outputFile) return false;
+        uint64_t outputHash = in.read_64();
+        int recordedIdent = in.read_32();
+        std::vector<ErrorMsg> warnings;
+        uint32_t count = in.read_32();
+        for (uint32_t i = 0; i < count; ++i) {
+            warnings.push_back(in.read_error());
+        }
+
+        std::string output;
+        if (!readCacheFile(outputFile, output) || hashText(output) != outputHash) {
+            return false;
+        }
+        nextIdent = recordedIdent;
+        for (const ErrorMsg &msg : warnings) {
+            gamedata.addError(msg.origin, msg.type, msg.message);
+        }
+        return true;
+    } catch (CacheError&) {
+        return false;
+    }
+}
+
+void BuildCache::setSourceHash(unsigned index, uint64_t hash) {
+    mSourceHashes[index] = hash;
+}
+
+void BuildCache::saveBuild(const std::string &outputFile, const GameData &gamedata, int nextIdent) {
+    std::string output;
+    if (!readCacheFile(outputFile, output)) return;
+
+    CacheWriter out;
+    out.write_header(BuildRecord, mBuilderId);
+    out.write_64(buildKey());
+    out.write_str(outputFile);
+    out.write_64(hashText(output));
+    out.write_32(nextIdent);
+    out.write_32(gamedata.errors.size());
+    for (const ErrorMsg &msg : gamedata.errors) {
+        out.write_error(msg);
+    }
+    writeCacheFile(pathFor("build.cache"), out);
+}
+
+// Token text that refers into the source file is stored as an offset, while
+// the text of strings that had escapes is stored in full.
+bool BuildCache::loadTokens(unsigned fileIndex, uint64_t sourceHash,
+                            std::vector<Token> &tokens) const {
+    SourceFile &file = getSourceFile(fileIndex);
+    std::string content;
+    if (!readCacheFile(tokenCachePath(file.name), content)) return false;
+
+    try {
+        CacheReader in(content);
+        in.read_header(TokenList, mBuilderId);
+        if (in.read_str() != file.name || in.read_64() != sourceHash) return false;
+        uint32_t count = in.read_32();
+        std::vector<Token> newTokens;
+        newTokens.reserve(count);
+        for (uint32_t i = 0; i < count; ++i) {
+            Token::Type type = static_cast<Token::Type>(in.read_8());
+            const char *textStart;
+            uint32_t textLength;
+            if (in.read_8()) {
+                // added straight to the file since a deque never moves its
+                // strings; one left over if the cache file is bad is harmless
+                file.strings.push_back(in.read_str());
+                textStart = file.strings.back().data();
+                textLength = file.strings.back().size();
+            } else {
+                uint32_t offset = in.read_32();
+                textLength = in.read_32();
+                if (offset > file.text.size() || textLength > file.text.size() - offset) {
+                    throw CacheError();
+                }
+                textStart = file.text.data() + offset;
+            }
+            int value = in.read_32();
+            int line = in.read_32();
+            int column = in.read_32();
+            newTokens.push_back(Token(Origin(fileIndex, line, column), type,
+                                      textStart, textLength, value));
+        }
+        tokens = std::move(newTokens);
+        return true;
+    } catch (CacheError&) {
+        return false;
+    }
+}
+
+void BuildCache::saveTokens(unsigned fileIndex, uint64_t sourceHash,
+                            const std::vector<Token> &tokens) const {
+    const SourceFile &file = getSourceFile(fileIndex);
+    const char *sourceStart = file.text.data();
+    const char *sourceEnd = sourceStart + file.text.size();
+
+    CacheWriter out;
+    out.write_header(TokenList, mBuilderId);
+    out.write_str(file.name);
+    out.write_64(sourceHash);
+    out.write_32(tokens.size());
+    for (const Token &token : tokens) {
+        out.write_8(token.type);
+        if (token.textLength == 0) {
+            out.write_8(0);
+            out.write_32(0);
+            out.write_32(0);
+        } else if (token.textStart >= sourceStart && token.textStart < sourceEnd) {
+            out.write_8(0);
+            out.write_32(token.textStart - sourceStart);
+            out.write_32(token.textLength);
+        } else {
+            out.write_8(1);
+            out.write_str(token.text());
+        }
+        out.write_32(token.value);
+        out.write_32(token.origin.line);
+        out.write_32(token.origin.column);
+    }
+    writeCacheFile(tokenCachePath(file.name), out);
+}
+
+void BuildCache::loadFunctions() {
+    mFunctions.clear();
+    std::string content;
+    if (!readCacheFile(pathFor("functions.cache"), content)) return;
+
+    try {
+        CacheReader in(content);
+        in.read_header(FunctionList, mBuilderId);
+        uint32_t count = in.read_32();
+        for (uint32_t i = 0; i < count; ++i) {
+            uint64_t key = in.read_64();
+            CachedFunction function;
+            uint32_t codeSize = in.read_32();
+            for (uint32_t j = 0; j < codeSize; ++j) {
+                function.code.push_back(in.read_8());
+            }
+            uint32_t warningCount = in.read_32();
+            for (uint32_t j = 0; j < warningCount; ++j) {
+                function.warnings.push_back(in.read_error());
+            }
+            uint32_t useCount = in.read_32();
+            for (uint32_t j = 0; j < useCount; ++j) {
+                function.symbolUses.push_back(in.read_str());
+            }
+            mFunctions.insert(std::make_pair(key, std::move(function)));
+        }
+    } catch (CacheError&) {
+        mFunctions.clear();
+    }
+}
+
+const CachedFunction* BuildCache::getFunction(uint64_t key) const {
+    auto iter = mFunctions.find(key);
+    if (iter == mFunctions.end()) return nullptr;
+    return &iter->second;
+}
+
+void BuildCache::saveFunctions(std::unordered_map<uint64_t, CachedFunction> &&functions) {
+    mFunctions = std::move(functions);
+
+    CacheWriter out;
+    out.write_header(FunctionList, mBuilderId);
+    out.write_32(mFunctions.size());
+    for (const auto &iter : mFunctions) {
+        const CachedFunction &function = iter.second;
+        out.write_64(iter.first);
+        out.write_32(function.code.size());
+        out.data.append(function.code.begin(), function.code.end());
+        out.write_32(function.warnings.size());
+        for (const ErrorMsg &msg : function.warnings) {
+            out.write_error(msg);
+        }
+        out.write_32(function.symbolUses.size());
+        for (const std::string &name : function.symbolUses) {
+            out.write_str(name);
+        }
+    }
+    writeCacheFile(pathFor("functions.cache"), out);
+}
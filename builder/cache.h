@@ -0,0 +1,85 @@
+/* **************************************************************************
+ * BuildCache Class Definition
+ *
+ * The build cache keeps the results of earlier builds on disk so later builds
+ * can skip the work for source files and functions that haven't changed.
+ *
+ * Part of GTRPE by Gren Drake
+ * **************************************************************************/
+
+#ifndef CACHE_H
+#define CACHE_H
+
+#include <cstdint>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "gamedata.h"
+
+class Token;
+
+// 64-bit FNV-1a hash used to key cache entries by their content.
+class Hasher {
+public:
+    Hasher()
+    : mHash(14695981039346656037ULL)
+    { }
+
+    void add(const void *data, size_t length);
+    void add(const std::string &text);
+    void add_32(uint32_t value);
+    void add_64(uint64_t value);
+    uint64_t hash() const {
+        return mHash;
+    }
+private:
+    uint64_t mHash;
+};
+
+struct CachedFunction {
+    std::vector<uint8_t> code;
+    std::vector<ErrorMsg> warnings;
+    std::vector<std::string> symbolUses;
+};
+
+class BuildCache {
+public:
+    BuildCache(const std::string &directory, const std::string &builderPath,
+               const std::vector<std::string> &sourceFiles, const std::string &settings);
+
+    // whole builds; a build is up to date if the sources and settings match
+    // the last successful build and its output file hasn't been changed
+    bool isUpToDate(const std::string &outputFile, GameData &gamedata, int &nextIdent);
+    void setSourceHash(unsigned index, uint64_t hash);
+    void saveBuild(const std::string &outputFile, const GameData &gamedata, int nextIdent);
+
+    // lexed tokens for each source file; these are safe to call from
+    // several threads at once for different files
+    bool loadTokens(unsigned fileIndex, uint64_t sourceHash,
+                    std::vector<Token> &tokens) const;
+    void saveTokens(unsigned fileIndex, uint64_t sourceHash,
+                    const std::vector<Token> &tokens) const;
+
+    // compiled function bodies, keyed by a hash of everything the compiled
+    // code depends on
+    void loadFunctions();
+    const CachedFunction* getFunction(uint64_t key) const;
+    void saveFunctions(std::unordered_map<uint64_t, CachedFunction> &&functions);
+
+private:
+    uint64_t buildKey() const;
+    std::string pathFor(const std::string &name) const;
+    std::string tokenCachePath(const std::string &filename) const;
+
+    std::string mDirectory;
+    std::string mBuilderId;
+    std::vector<std::string> mSourceFiles;
+    std::string mSettings;
+    std::vector<uint64_t> mSourceHashes;
+    std::unordered_map<uint64_t, CachedFunction> mFunctions;
+};
+
+uint64_t hashText(const std::string &text);
+
+#endif
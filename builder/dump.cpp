@@ -179,6 +179,43 @@ void dump_asm(GameData &gamedata, std::ostream &out) {
                         out << ' ' << value;
                         out << ": " << static_cast<Value::Type>(type);
                         break;
+                    case OpcodeDef::CallDirect:
+                    case OpcodeDef::TailCallDirect:
+                        value = function->code.read_32(i);
+                        i += 4;
+                        out << " #" << value;
+                        out << " args: " << static_cast<int>(function->code.read_8(i++));
+                        if (function->code.read_8(i++)) out << " (checked)";
+                        break;
+                    case OpcodeDef::RegisterOp: {
+                        const OpcodeDef *operation = getOpcodeByCode(function->code.read_8(i++));
+                        out << ' ' << (operation ? operation->name : "(unknown)");
+                        for (int operand = 0; operand < 3; ++operand) {
+                            out << (operand == 0 ? " -> " : " ");
+                            switch(function->code.read_8(i++)) {
+                                case REGISTER_STACK:
+                                    out << "stack";
+                                    break;
+                                case REGISTER_LOCAL:
+                                    out << "local " << static_cast<int>(function->code.read_8(i++));
+                                    break;
+                                case REGISTER_CONSTANT:
+                                    type = function->code.read_8(i++);
+                                    value = function->code.read_32(i);
+                                    i += 4;
+                                    out << value << ": " << static_cast<Value::Type>(type);
+                                    break;
+                                case REGISTER_JUMP_ZERO:
+                                    out << "jz " << function->code.read_32(i);
+                                    i += 4;
+                                    break;
+                                case REGISTER_JUMP_NOT_ZERO:
+                                    out << "jnz " << function->code.read_32(i);
+                                    i += 4;
+                                    break;
+                            }
+                        }
+                        break; }
                 }
                 out << "\n";
             }
@@ -266,6 +303,51 @@ void dump_ir(GameData &gamedata, std::ostream &out) {
                 continue;
             }
 
+            const AsmCall *call = dynamic_cast<const AsmCall*>(line);
+            if (call) {
+                const FunctionDef *callee = gamedata.functionById(call->functionId);
+                work << (call->tailCall ? "tail_call_direct #" : "call_direct #") << call->functionId;
+                if (callee) work << " (" << callee->name << ')';
+                work << " args: " << call->argumentCount;
+                if (call->checkTypes) work << " (checked)";
+                out << std::setw(IR_WIDTH) << work.str() << line->getOrigin() << "\n";
+                continue;
+            }
+
+            const AsmRegisterOp *registerOp = dynamic_cast<const AsmRegisterOp*>(line);
+            if (registerOp) {
+                const OpcodeDef *opdef = getOpcodeByCode(registerOp->opcode);
+                work << "register_op ";
+                if (opdef)  work << opdef->name;
+                else        work << '(' << registerOp->opcode << ')';
+                const AsmRegisterOp::Operand *operands[] = {
+                    &registerOp->result, &registerOp->top, &registerOp->lower
+                };
+                for (const AsmRegisterOp::Operand *operand : operands) {
+                    work << (operand == operands[0] ? " -> " : " ");
+                    switch(operand->kind) {
+                        case REGISTER_STACK:
+                            work << "stack";
+                            break;
+                        case REGISTER_LOCAL: {
+                            const LocalDef *def = function->getLocal(operand->value.value);
+                            work << (def ? def->name : "INVALID");
+                            break; }
+                        case REGISTER_CONSTANT:
+                            work << operand->value;
+                            break;
+                        case REGISTER_JUMP_ZERO:
+                            work << "jz " << operand->value.text;
+                            break;
+                        case REGISTER_JUMP_NOT_ZERO:
+                            work << "jnz " << operand->value.text;
+                            break;
+                    }
+                }
+                out << std::setw(IR_WIDTH) << work.str() << line->getOrigin() << "\n";
+                continue;
+            }
+
             const AsmValue *value = dynamic_cast<const AsmValue*>(line);
             if (value) {
                 work << "push " << value->value;
@@ -12,7 +12,7 @@
 #include "opcode.h"
 
 void handle_asm_stmt(GameData &gamedata, FunctionDef *function, List *list);
-void handle_call_stmt(GameData &gamedata, FunctionDef *function, List *list);
+void handle_call_stmt(GameData &gamedata, FunctionDef *function, List *list, bool tailCall);
 void handle_reserved_stmt(GameData &gamedata, FunctionDef *function, List *list);
 void stmt_and(GameData &gamedata, FunctionDef *function, List *list);
 void stmt_asm(GameData &gamedata, FunctionDef *function, List *list);
@@ -147,7 +147,54 @@ void handle_asm_stmt(GameData &gamedata, FunctionDef *function, List *list) {
     }
 }
 
-void handle_call_stmt(GameData &gamedata, FunctionDef *function, List *list) {
+// Compare the arguments of a call to a known function with the types the
+// function declares for them. Returns true if every argument is known to have
+// the declared type, meaning the check can be left out at runtime; arguments
+// known to have the wrong type produce a warning.
+static bool check_call_arguments(GameData &gamedata, const FunctionDef *callee, const List *list) {
+    bool allKnown = true;
+    for (int i = 1; i < callee->argument_count; ++i) {
+        const Value::Type expected = callee->locals[i].type;
+        if (expected == Value::Any) continue;
+
+        Origin origin = list->values[0].origin;
+        Value::Type actual = Value::None;
+        if (i < static_cast<int>(list->values.size())) {
+            origin = list->values[i].origin;
+            actual = list->values[i].value.type;
+        }
+        switch(actual) {
+            case Value::None:
+            case Value::Integer:
+            case Value::String:
+            case Value::List:
+            case Value::Map:
+            case Value::Function:
+            case Value::Object:
+            case Value::Property:
+            case Value::TypeId:
+            case Value::VarRef:
+            case Value::Vocab:
+                break;
+            default:
+                // only known when the game is run
+                allKnown = false;
+                continue;
+        }
+        if (actual != expected) {
+            std::stringstream ss;
+            ss << "Function " << callee->name << " expects argument " << i;
+            ss << " to be " << expected << " but receives " << actual << '.';
+            gamedata.addError(origin, ErrorMsg::Warning, ss.str());
+            allKnown = false;
+        }
+    }
+    return allKnown;
+}
+
+// Compile a call. A tail call replaces the calling function with the one
+// being called, so it must be the last thing done before returning.
+void handle_call_stmt(GameData &gamedata, FunctionDef *function, List *list, bool tailCall) {
     const ListValue &func = list->values[0];
     const int argumentCount = list->values.size() - 1;
 
@@ -161,13 +208,22 @@ void handle_call_stmt(GameData &gamedata, FunctionDef *function, List *list) {
         }
     }
 
+    if (func.value.type == Value::Function && argumentCount <= 255) {
+        const FunctionDef *callee = gamedata.functionById(func.value.value);
+        if (callee) {
+            bool checkTypes = !check_call_arguments(gamedata, callee, list);
+            function->addCall(func.origin, callee->globalId, argumentCount, checkTypes, tailCall);
+            return;
+        }
+    }
+
     function->addValue(func.origin, Value{Value::Integer, argumentCount});
     if (func.value.type == Value::Expression) {
         process_list(gamedata, function, func.list);
     } else {
         function->addValue(func.origin, func.value);
     }
-    function->addOpcode(func.origin, OpcodeDef::Call);
+    function->addOpcode(func.origin, tailCall ? OpcodeDef::TailCall : OpcodeDef::Call);
 }
 
 void handle_reserved_stmt(GameData &gamedata, FunctionDef *function, List *list) {
@@ -480,6 +536,19 @@ void stmt_return(GameData &gamedata, FunctionDef *function, List *list) {
     }
 
     if (list->values.size() > 1) {
+        // returning the result of a call can be done as a tail call
+        const ListValue &value = list->values[1];
+        if (value.value.type == Value::Expression && value.list && !value.list->values.empty()) {
+            switch(value.list->values[0].value.type) {
+                case Value::Function:
+                case Value::LocalVar:
+                case Value::Expression:
+                    handle_call_stmt(gamedata, function, value.list, true);
+                    return;
+                default:
+                    break;
+            }
+        }
         process_value(gamedata, function, list->values[1]);
     } else {
         function->addValue(list->values[0].origin, Value{Value::None});
@@ -634,7 +703,7 @@ void process_list(GameData &gamedata, FunctionDef *function, List *list) {
         case Value::Function:
         case Value::LocalVar:
         case Value::Expression:
-            handle_call_stmt(gamedata, function, list);
+            handle_call_stmt(gamedata, function, list, false);
             break;
         case Value::Opcode:
             handle_asm_stmt(gamedata, function, list);
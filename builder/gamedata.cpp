@@ -33,6 +33,11 @@ void FunctionDef::addValue(const Origin &origin, const Value &value) {
     asmCode.push_back(new AsmValue(origin, value));
 }
 
+void FunctionDef::addCall(const Origin &origin, int functionId, int argumentCount, bool checkTypes,
+                          bool tailCall) {
+    asmCode.push_back(new AsmCall(origin, functionId, argumentCount, checkTypes, tailCall));
+}
+
 void FunctionDef::addLocal(const std::string &name, Value::Type type, bool alwaysUsed) {
     if (alwaysUsed) {
         locals.push_back(LocalDef{ name, type, 1 });
@@ -99,12 +104,14 @@ GameData::~GameData() {
 }
 
 unsigned GameData::getPropertyId(const std::string &name) {
-    auto existing = std::find(propertyNames.begin(), propertyNames.end(), name);
-    if (existing != propertyNames.end()) {
-        return existing - propertyNames.begin();
+    auto existing = mPropertyIndex.find(name);
+    if (existing != mPropertyIndex.end()) {
+        return existing->second;
     }
+    unsigned ident = propertyNames.size();
     propertyNames.push_back(name);
-    return propertyNames.size() - 1;
+    mPropertyIndex.insert(std::make_pair(name, ident));
+    return ident;
 }
 
 const std::string* GameData::getPropertyName(unsigned id) const {
@@ -115,13 +122,25 @@ const std::string* GameData::getPropertyName(unsigned id) const {
 }
 
 unsigned GameData::getStringId(std::string name) {
+    // the same literal usually appears many times, so remember the text as
+    // written to avoid normalizing it again
+    auto seen = mRawStringIndex.find(name);
+    if (seen != mRawStringIndex.end()) {
+        return seen->second;
+    }
+    std::string raw = name;
     normalize(name);
-    auto existing = std::find(stringTable.begin(), stringTable.end(), name);
-    if (existing != stringTable.end()) {
-        return existing - stringTable.begin();
+    unsigned ident;
+    auto existing = mStringIndex.find(name);
+    if (existing != mStringIndex.end()) {
+        ident = existing->second;
+    } else {
+        ident = stringTable.size();
+        stringTable.push_back(name);
+        mStringIndex.insert(std::make_pair(name, ident));
     }
-    stringTable.push_back(name);
-    return stringTable.size() - 1;
+    mRawStringIndex.insert(std::make_pair(raw, ident));
+    return ident;
 }
 
 const std::string& GameData::getString(unsigned id) const {
@@ -209,6 +228,16 @@ FunctionDef* GameData::functionByName(const std::string &name) {
     return nullptr;
 }
 
+void GameData::addFunction(FunctionDef *function) {
+    functions.push_back(function);
+    mFunctionIndex[function->globalId] = function;
+}
+
+void GameData::addObject(GameObject *object) {
+    objects.push_back(object);
+    mObjectIndex[object->globalId] = object;
+}
+
 int GameData::checkObjectIdents() {
     const unsigned pIdent = getPropertyId("ident");
     const unsigned pSave = getPropertyId("save");
@@ -265,39 +294,55 @@ int GameData::checkObjectIdents() {
     return nextIdent < 0 ? 1 : nextIdent;
 }
 
+static thread_local ErrorBuffer *currentErrorBuffer = nullptr;
+
+ErrorBuffer::ErrorBuffer()
+: errorCount(0), mPrevious(currentErrorBuffer) {
+    currentErrorBuffer = this;
+}
+
+ErrorBuffer::~ErrorBuffer() {
+    currentErrorBuffer = mPrevious;
+}
+
 void GameData::addError(const Origin &origin, ErrorMsg::Type type, const std::string &text) {
+    if (currentErrorBuffer) {
+        currentErrorBuffer->errors.push_back(ErrorMsg{type, origin, text});
+        if (type != ErrorMsg::Warning) ++currentErrorBuffer->errorCount;
+        return;
+    }
     errors.push_back(ErrorMsg{type, origin, text});
     if (type != ErrorMsg::Warning) ++errorCount;
 }
 
 bool GameData::hasErrors() const {
+    if (currentErrorBuffer && currentErrorBuffer->errorCount > 0) return true;
     return errorCount > 0;
 }
 
 void GameData::addVocab(const std::string &word) {
-    if (getVocabNumber(word) < 0) {
+    if (mVocabIndex.insert(std::make_pair(word, vocab.size())).second) {
         vocab.push_back(word);
     }
 }
 
 int GameData::getVocabNumber(const std::string &word) const {
-    int count = 0;
-    for (const std::string &v : vocab) {
-        if (v == word) return count;
-        ++count;
-    }
-    return -1;
+    auto existing = mVocabIndex.find(word);
+    if (existing == mVocabIndex.end()) return -1;
+    return existing->second;
 }
 
 void GameData::sortVocab() {
     std::sort(vocab.begin(), vocab.end());
+    for (unsigned i = 0; i < vocab.size(); ++i) {
+        mVocabIndex[vocab[i]] = i;
+    }
 }
 
 GameObject* GameData::objectById(int ident) {
-    for (GameObject *o : objects) {
-        if (o && o->globalId == ident) return o;
-    }
-    return nullptr;
+    auto iter = mObjectIndex.find(ident);
+    if (iter == mObjectIndex.end()) return nullptr;
+    return iter->second;
 }
 
 GameList* GameData::listById(int ident) {
@@ -315,10 +360,9 @@ GameMap* GameData::mapById(int ident) {
 }
 
 FunctionDef* GameData::functionById(int ident) {
-    for (FunctionDef *o : functions) {
-        if (o && o->globalId == ident) return o;
-    }
-    return nullptr;
+    auto iter = mFunctionIndex.find(ident);
+    if (iter == mFunctionIndex.end()) return nullptr;
+    return iter->second;
 }
 
 FlagSet* GameData::flagSetById(int ident) {
@@ -2,12 +2,14 @@
 #define GAMEDATA_H
 
 #include "bytestream.h"
+#include "opcode.h"
 #include "origin.h"
 #include "symboltable.h"
 #include "token.h"
 #include "value.h"
 #include <map>
 #include <string>
+#include <unordered_map>
 #include <vector>
 #include <iosfwd>
 
@@ -37,6 +39,7 @@ struct GameObject {
     std::string name;
     int globalId;
     int nameString;
+    int fileNameString;
 
     std::string parentName;
     int parentId, childId, siblingId;
@@ -46,6 +49,7 @@ struct GameList {
     Origin origin;
     std::vector<Value> items;
     int globalId;
+    int fileNameString;
 };
 
 struct GameMap {
@@ -57,6 +61,7 @@ struct GameMap {
     Origin origin;
     std::vector<MapRow> rows;
     int globalId;
+    int fileNameString;
 };
 
 struct FlagSet {
@@ -75,12 +80,16 @@ struct Backpatch {
 struct AsmValue;
 struct AsmLabel;
 struct AsmOpcode;
+struct AsmCall;
+struct AsmRegisterOp;
 struct FunctionDef;
 class GameData;
 struct FunctionBuilder {
     void build(const AsmValue *value);
     void build(const AsmLabel *label);
     void build(const AsmOpcode *opcode);
+    void build(const AsmCall *call);
+    void build(const AsmRegisterOp *op);
     FunctionDef *forFunction;
     GameData &gamedata;
     std::vector<Backpatch> patches;
@@ -130,6 +139,54 @@ struct AsmValue : public AsmLine {
     Value value;
     unsigned mSize;
 };
+// a call to a function known when the game is built; the arguments are
+// already on the stack
+struct AsmCall : public AsmLine {
+    AsmCall(const Origin &origin, int functionId, int argumentCount, bool checkTypes, bool tailCall)
+    : AsmLine(origin), functionId(functionId), argumentCount(argumentCount),
+      checkTypes(checkTypes), tailCall(tailCall)
+    { }
+    virtual ~AsmCall() override { }
+    virtual void build(FunctionBuilder &builder) const override { builder.build(this); }
+    virtual unsigned getSize() const override { return 7; };
+
+    int functionId;
+    int argumentCount;
+    bool checkTypes;
+    bool tailCall;
+};
+// a binary operation that can take its operands from locals or constants
+// and put its result in a local or use it to decide a jump, rather than
+// going through the stack
+struct AsmRegisterOp : public AsmLine {
+    struct Operand {
+        int kind;       // one of the REGISTER_ values from opcode.h
+        Value value;    // local number, constant, or jump label
+    };
+
+    AsmRegisterOp(const Origin &origin, int opcode, const Operand &result,
+                  const Operand &top, const Operand &lower)
+    : AsmLine(origin), opcode(opcode), result(result), top(top), lower(lower)
+    { }
+    virtual ~AsmRegisterOp() override { }
+    virtual void build(FunctionBuilder &builder) const override { builder.build(this); }
+    virtual unsigned getSize() const override {
+        return 5 + operandSize(result) + operandSize(top) + operandSize(lower);
+    };
+    static unsigned operandSize(const Operand &operand) {
+        switch(operand.kind) {
+            case REGISTER_LOCAL:            return 1;
+            case REGISTER_CONSTANT:         return 5;
+            case REGISTER_JUMP_ZERO:
+            case REGISTER_JUMP_NOT_ZERO:    return 4;
+            default:                        return 0;
+        }
+    }
+
+    int opcode;
+    Operand result;
+    Operand top, lower;
+};
 
 struct LocalDef {
     std::string name;
@@ -138,7 +195,7 @@ struct LocalDef {
 };
 struct FunctionDef {
     FunctionDef()
-    : argument_count(0), local_count(0), nameString(0), codePosition(0),
+    : argument_count(0), local_count(0), nameString(0), fileNameString(-1), codePosition(0),
       codeEndPosition(0), globalId(0), isAsm(false), nextLabel(1)
     { }
     ~FunctionDef();
@@ -146,6 +203,8 @@ struct FunctionDef {
     void addLabel(const Origin &origin, const std::string &label);
     void addOpcode(const Origin &origin, int opcode);
     void addValue(const Origin &origin, const Value &value);
+    void addCall(const Origin &origin, int functionId, int argumentCount, bool checkTypes,
+                 bool tailCall = false);
 
     void addLocal(const std::string &name, Value::Type type, bool alwaysUsed = false);
     const LocalDef* getLocal(int position) const;
@@ -158,6 +217,7 @@ struct FunctionDef {
     int argument_count;
     int local_count;
     int nameString;
+    int fileNameString;
     std::vector<LocalDef> locals;
     std::map<std::string, unsigned> labels;
     std::string name;
@@ -170,6 +230,9 @@ struct FunctionDef {
     int nextLabel;
     std::vector<std::string> continueLabels;
     std::vector<std::string> breakLabels;
+    // symbols referred to by the function body; counted as uses once the
+    // function is compiled
+    std::vector<const SymbolDef*> symbolUses;
 };
 
 class GameData {
@@ -184,6 +247,8 @@ public:
     bool isIndirectLoop(int childId, int parentId);
     void organize();
     FunctionDef* functionByName(const std::string &name);
+    void addFunction(FunctionDef *function);
+    void addObject(GameObject *object);
     int checkObjectIdents();
     unsigned getSourceFileIndex(const std::string &filename);
     void addError(const Origin &origin, ErrorMsg::Type type, const std::string &text);
@@ -217,6 +282,30 @@ public:
     std::streampos functionsStart, bytecodeStart, fileEnd;
 
     int nextAnonymousId;
+private:
+    // indexes from text to position in propertyNames, stringTable, and
+    // vocab; mRawStringIndex maps string text from before normalization
+    std::unordered_map<std::string, unsigned> mPropertyIndex;
+    std::unordered_map<std::string, unsigned> mStringIndex;
+    std::unordered_map<std::string, unsigned> mRawStringIndex;
+    std::unordered_map<std::string, unsigned> mVocabIndex;
+    // indexes from global id to the entry in functions and objects
+    std::unordered_map<int, FunctionDef*> mFunctionIndex;
+    std::unordered_map<int, GameObject*> mObjectIndex;
+};
+
+// While an ErrorBuffer exists, errors added on the thread that created it
+// are kept in the buffer instead of being added to the GameData. This lets
+// work done in parallel report its errors in a fixed order.
+class ErrorBuffer {
+public:
+    ErrorBuffer();
+    ~ErrorBuffer();
+
+    std::vector<ErrorMsg> errors;
+    int errorCount;
+private:
+    ErrorBuffer *mPrevious;
 };
 
 std::ostream& operator<<(std::ostream &out, const Value &property);
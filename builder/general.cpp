@@ -9,8 +9,12 @@
 #include <algorithm>
 #include <cstring>
 #include <fstream>
+#include <memory>
+#include <mutex>
 #include <string>
 #include <sstream>
+#include <unordered_map>
+#include <vector>
 
 #include "gamedata.h"
 #include "symboltable.h"
@@ -109,13 +113,13 @@ std::ostream& operator<<(std::ostream &out, const Token &token) {
             out << ' ' << token.value;
             break;
         case Token::String:
-            out << " ~" << token.text << '~';
+            out << " ~" << token.text() << '~';
             break;
         case Token::Identifier:
-            out << ' ' << token.text;
+            out << ' ' << token.text();
             break;
         case Token::Property:
-            out << ' ' << token.text << '[' << token.value << ']';
+            out << ' ' << token.text() << '[' << token.value << ']';
             break;
 
         case Token::OpenBrace:
@@ -141,9 +145,53 @@ std::ostream& operator<<(std::ostream &out, const Token &token) {
 /* ************************************************************************** *
  * Definitions for Origin class                                                *
  * ************************************************************************** */
+struct SourceFileList {
+    SourceFileList() {
+        files.push_back(std::unique_ptr<SourceFile>(new SourceFile{"(internal)"}));
+        indexes.insert(std::make_pair(files.back()->name, 0));
+    }
+
+    std::mutex mutex;
+    std::vector<std::unique_ptr<SourceFile>> files;
+    std::unordered_map<std::string, unsigned> indexes;
+};
+
+static SourceFileList& sourceFiles() {
+    static SourceFileList list;
+    return list;
+}
+
+// Files are added each time they're read, even if a file of the same name
+// was read before, so tokens never refer into text that has been replaced.
+unsigned addSourceFile(const std::string &name, std::string &&text) {
+    SourceFileList &list = sourceFiles();
+    std::lock_guard<std::mutex> lock(list.mutex);
+    list.files.push_back(std::unique_ptr<SourceFile>(new SourceFile{name, std::move(text)}));
+    unsigned index = list.files.size() - 1;
+    list.indexes.insert(std::make_pair(name, index));
+    return index;
+}
+
+unsigned getSourceFileIndex(const std::string &name) {
+    SourceFileList &list = sourceFiles();
+    std::lock_guard<std::mutex> lock(list.mutex);
+    auto iter = list.indexes.find(name);
+    if (iter != list.indexes.end()) return iter->second;
+    list.files.push_back(std::unique_ptr<SourceFile>(new SourceFile{name}));
+    unsigned index = list.files.size() - 1;
+    list.indexes.insert(std::make_pair(name, index));
+    return index;
+}
+
+SourceFile& getSourceFile(unsigned index) {
+    SourceFileList &list = sourceFiles();
+    std::lock_guard<std::mutex> lock(list.mutex);
+    return *list.files.at(index);
+}
+
 std::ostream& operator<<(std::ostream &out, const Origin &origin) {
     std::stringstream ss;
-    ss << origin.file;
+    ss << origin.file();
     if (origin.line > 0) {
         ss << ':' << origin.line;
         if (origin.column > 0) {
@@ -194,24 +242,18 @@ void SymbolTable::add(const Origin &definingAt, const SymbolDef &symbol) {
         throw BuildError(symbol.origin, ss.str());
     }
     symbols.push_back(symbol);
+    mIndex.insert(std::make_pair(symbol.name, &symbols.back()));
 }
 const SymbolDef* SymbolTable::get(const std::string &name, bool countsAsUse) {
-    for (SymbolDef &symbol : symbols) {
-        if (symbol.name == name) {
-            if (countsAsUse) ++symbol.uses;
-            return &symbol;
-        }
-    }
-    return nullptr;
+    auto iter = mIndex.find(name);
+    if (iter == mIndex.end()) return nullptr;
+    if (countsAsUse) ++iter->second->uses;
+    return iter->second;
 }
 
 void SymbolTable::markUsed(const std::string &name) {
-    for (SymbolDef &symbol : symbols) {
-        if (symbol.name == name) {
-            ++symbol.uses;
-            return;
-        }
-    }
+    auto iter = mIndex.find(name);
+    if (iter != mIndex.end()) ++iter->second->uses;
 }
 
 std::ostream& operator<<(std::ostream &out, const SymbolDef::Type &type) {
@@ -239,7 +281,7 @@ std::string readFile(const std::string &file) {
     if (!inf) {
         throw BuildError(Origin(), "Could not open file "+file+".");
     }
-    std::string content( (std::istreambuf_iterator<char>(inf)),
-                         std::istreambuf_iterator<char>() );
-    return content;
+    std::stringstream content;
+    content << inf.rdbuf();
+    return content.str();
 }
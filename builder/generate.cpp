@@ -111,7 +111,7 @@ void generate(GameData &gamedata, const std::string &outputFile) {
     for (unsigned i = 0; i < gamedata.lists.size(); ++i) {
         const GameList *list = gamedata.lists[i];
         if (list == nullptr) continue;
-        write_32(out, list->origin.fileNameString);
+        write_32(out, list->fileNameString);
         write_32(out, list->origin.line);
         write_32(out, list->globalId);
         write_16(out, list->items.size());
@@ -127,7 +127,7 @@ void generate(GameData &gamedata, const std::string &outputFile) {
     for (unsigned i = 0; i < gamedata.maps.size(); ++i) {
         const GameMap *map = gamedata.maps[i];
         if (map == nullptr) continue;
-        write_32(out, map->origin.fileNameString);
+        write_32(out, map->fileNameString);
         write_32(out, map->origin.line);
         write_32(out, map->globalId);
         write_16(out, map->rows.size());
@@ -145,7 +145,7 @@ void generate(GameData &gamedata, const std::string &outputFile) {
     for (const GameObject *object : gamedata.objects) {
         if (object == nullptr) continue;
         write_32(out, object->nameString);
-        write_32(out, object->origin.fileNameString);
+        write_32(out, object->fileNameString);
         write_32(out, object->origin.line);
         write_32(out, object->globalId);
         write_32(out, object->parentId);
@@ -166,7 +166,7 @@ void generate(GameData &gamedata, const std::string &outputFile) {
         const FunctionDef *function = gamedata.functions[i];
         if (function == nullptr) continue;
         write_32(out, function->nameString);
-        write_32(out, function->origin.fileNameString);
+        write_32(out, function->fileNameString);
         write_32(out, function->origin.line);
         write_32(out, function->globalId);
         write_16(out, function->argument_count);
@@ -1,3 +1,7 @@
+#include <algorithm>
+#include <exception>
+#include <iterator>
+#include <memory>
 #include <string>
 #include <sstream>
 #include <vector>
@@ -5,7 +9,9 @@
 #include "gamedata.h"
 #include "builderror.h"
 #include "build.h"
+#include "cache.h"
 #include "origin.h"
+#include "threadpool.h"
 #include "token.h"
 
 struct LexerState {
@@ -15,10 +21,94 @@ struct LexerState {
 };
 
 void handle_string_escapes(GameData &gamedata, const Origin &origin, std::string &text);
+static std::vector<Token> lex_source(GameData &gamedata, unsigned fileIndex);
 
 std::vector<Token> lex_file(GameData &gamedata, const std::string &filename) {
-    std::string text = readFile(filename);
-    return lex_string(gamedata, filename, text);
+    unsigned fileIndex = addSourceFile(filename, readFile(filename));
+    return lex_source(gamedata, fileIndex);
+}
+
+struct LexedFile {
+    // errors and vocab found in this file only; property ids in the tokens
+    // are also local to this file until merged
+    GameData gamedata;
+    std::vector<Token> tokens;
+    std::exception_ptr error;
+};
+
+// Lex a file, or reuse its tokens from the last build if it hasn't changed.
+static std::vector<Token> lex_cached(GameData &gamedata, BuildCache &cache,
+                                     unsigned index, const std::string &filename) {
+    unsigned fileIndex = addSourceFile(filename, readFile(filename));
+    uint64_t sourceHash = hashText(getSourceFile(fileIndex).text);
+    cache.setSourceHash(index, sourceHash);
+
+    std::vector<Token> tokens;
+    if (cache.loadTokens(fileIndex, sourceHash, tokens)) {
+        for (const Token &token : tokens) {
+            if (token.type == Token::Vocab) gamedata.addVocab(token.text());
+        }
+        return tokens;
+    }
+    tokens = lex_source(gamedata, fileIndex);
+    if (!gamedata.hasErrors()) {
+        cache.saveTokens(fileIndex, sourceHash, tokens);
+    }
+    return tokens;
+}
+
+// Lex each file on its own thread, then merge the results in the order the
+// files were given so errors, vocab, and property ids come out the same as
+// lexing the files one after another.
+std::vector<Token> lex_files(GameData &gamedata, const std::vector<std::string> &filenames,
+                             int threadCount, BuildCache *cache) {
+    std::vector<std::unique_ptr<LexedFile>> files;
+    for (unsigned i = 0; i < filenames.size(); ++i) {
+        files.push_back(std::unique_ptr<LexedFile>(new LexedFile));
+    }
+    {
+        ThreadPool pool(threadCount);
+        for (unsigned i = 0; i < filenames.size(); ++i) {
+            LexedFile *file = files[i].get();
+            const std::string &filename = filenames[i];
+            pool.submit([file, &filename, cache, i]{
+                try {
+                    if (cache) {
+                        file->tokens = lex_cached(file->gamedata, *cache, i, filename);
+                    } else {
+                        file->tokens = lex_file(file->gamedata, filename);
+                    }
+                } catch (...) {
+                    file->error = std::current_exception();
+                }
+            });
+        }
+        pool.wait();
+    }
+
+    size_t tokenCount = 0;
+    for (const std::unique_ptr<LexedFile> &file : files) {
+        tokenCount += file->tokens.size();
+    }
+    std::vector<Token> tokens;
+    tokens.reserve(tokenCount);
+    for (const std::unique_ptr<LexedFile> &file : files) {
+        for (const ErrorMsg &msg : file->gamedata.errors) {
+            gamedata.addError(msg.origin, msg.type, msg.message);
+        }
+        if (file->error) std::rethrow_exception(file->error);
+        for (const std::string &word : file->gamedata.vocab) {
+            gamedata.addVocab(word);
+        }
+        for (Token &token : file->tokens) {
+            if (token.type == Token::Property) {
+                token.value = gamedata.getPropertyId(token.text());
+            }
+        }
+        tokens.insert(tokens.end(), std::make_move_iterator(file->tokens.begin()),
+                                    std::make_move_iterator(file->tokens.end()));
+    }
+    return tokens;
 }
 
 
@@ -98,7 +188,13 @@ void handle_string_escapes(GameData &gamedata, const Origin &origin, std::string
 }
 
 std::vector<Token> lex_string(GameData &gamedata, const std::string &source_name, const std::string &text) {
-    LexerState state = { { source_name, 1, 1}, text };
+    unsigned fileIndex = addSourceFile(source_name, std::string(text));
+    return lex_source(gamedata, fileIndex);
+}
+
+static std::vector<Token> lex_source(GameData &gamedata, unsigned fileIndex) {
+    SourceFile &file = getSourceFile(fileIndex);
+    LexerState state = { { fileIndex, 1, 1}, file.text };
     std::vector<Token> tokens;
 
 
@@ -186,26 +282,36 @@ std::vector<Token> lex_string(GameData &gamedata, const std::string &source_name
                 if (here(state) == '\\') next(state);
                 next(state);
             }
-            std::string text = state.text.substr(start, state.pos - start);
-            handle_string_escapes(gamedata, origin, text);
+            const char *textStart = state.text.data() + start;
+            unsigned textLength = state.pos - start;
+            // only strings with escapes or line breaks are changed, so only
+            // those need a copy of their text
+            if (std::find_if(textStart, textStart + textLength,
+                    [](char c) { return c == '\\' || c == '\n'; }) != textStart + textLength) {
+                std::string text(textStart, textLength);
+                handle_string_escapes(gamedata, origin, text);
+                file.strings.push_back(std::move(text));
+                textStart = file.strings.back().data();
+                textLength = file.strings.back().size();
+            }
             if (quote_char == '"') {
-                if (text.size() > UINT16_MAX) {
+                if (textLength > UINT16_MAX) {
                     std::stringstream ss;
                     ss << "WARNING String exceeds max string length of ";
                     ss << (UINT16_MAX - 1) << "; excess data truncated.";
                     gamedata.addError(origin, ErrorMsg::Error, ss.str());
-                    text.erase(UINT16_MAX);
+                    textLength = UINT16_MAX;
                 }
-                tokens.push_back(Token(origin, Token::String, text));
+                tokens.push_back(Token(origin, Token::String, textStart, textLength));
             } else if (quote_char == '`') {
-                gamedata.addVocab(text);
-                tokens.push_back(Token(origin, Token::Vocab, text));
+                gamedata.addVocab(std::string(textStart, textLength));
+                tokens.push_back(Token(origin, Token::Vocab, textStart, textLength));
             } else {
-                if (text.size() != 1) {
+                if (textLength != 1) {
                     gamedata.addError(origin, ErrorMsg::Error,
                         "character literal has invalid length");
                 } else {
-                    tokens.push_back(Token(origin, Token::Integer, text[0]));
+                    tokens.push_back(Token(origin, Token::Integer, textStart[0]));
                 }
             }
             next(state);
@@ -218,13 +324,14 @@ std::vector<Token> lex_string(GameData &gamedata, const std::string &source_name
             while (isValidIdentifier(here(state))) {
                 next(state);
             }
-            std::string text = state.text.substr(start, state.pos - start);
-            if (text.empty()) {
+            const char *textStart = state.text.data() + start;
+            unsigned textLength = state.pos - start;
+            if (textLength == 0) {
                     gamedata.addError(origin, ErrorMsg::Error,
                         "found empty property name");
             }
-            unsigned propertyId = gamedata.getPropertyId(text);
-            tokens.push_back(Token(origin, Token::Property, text, propertyId));
+            unsigned propertyId = gamedata.getPropertyId(std::string(textStart, textLength));
+            tokens.push_back(Token(origin, Token::Property, textStart, textLength, propertyId));
             continue;
 
         } else if (isValidIdentifier(c)) {
@@ -241,7 +348,8 @@ std::vector<Token> lex_string(GameData &gamedata, const std::string &source_name
             } else if (ipe == IntParseError::OUT_OF_RANGE) {
                 gamedata.addError(origin, ErrorMsg::Error, "Integer " + text + " not a valid 32bit value.");
             } else { // not a number
-                tokens.push_back(Token(origin, Token::Identifier, text));
+                tokens.push_back(Token(origin, Token::Identifier,
+                                       state.text.data() + start, text.size()));
             }
             continue;
 
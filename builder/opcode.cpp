@@ -71,6 +71,9 @@ OpcodeDef opcodes[] = {
     {   "str_compare",  OpcodeDef::StringCompare,           2, 1 },
     {   "error",        OpcodeDef::Error,                   1, 0 },
     {   "origin",       OpcodeDef::Origin,                  1, 1 },
+    {   "call_direct",  OpcodeDef::CallDirect,              0, 1, FORBID_ALWAYS },
+    {   "tail_call",    OpcodeDef::TailCall,                2, 0, FORBID_ALWAYS },
+    {   "tail_call_direct",OpcodeDef::TailCallDirect,       0, 0, FORBID_ALWAYS },
     {   "new",          OpcodeDef::New,                     1, 1 },
     {   "is_static",    OpcodeDef::IsStatic,                1, 1 },
     {   "encode_string",OpcodeDef::EncodeString,            1, 1 },
@@ -86,6 +89,8 @@ OpcodeDef opcodes[] = {
     {   "children",     OpcodeDef::GetChildren,             1, 1 },
     {   "child_count",  OpcodeDef::GetChildCount,           1, 1 },
     {   "move_to",      OpcodeDef::MoveTo,                  2, 0 },
+    {   "register_op",  OpcodeDef::RegisterOp,              0, 0, FORBID_ALWAYS },
+    {   "heap_stat",    OpcodeDef::HeapStat,                1, 1 },
 
     {   ""                                                       }
 };
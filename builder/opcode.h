@@ -7,6 +7,13 @@ const int FORBID_ALWAYS     = 0xFF;
 const int FORBID_ASM        = 0x01;
 const int FORBID_EXPRESSION = 0x02;
 
+// where the operands of register_op come from and where its result goes
+const int REGISTER_STACK            = 0;
+const int REGISTER_LOCAL            = 1;
+const int REGISTER_CONSTANT         = 2;
+const int REGISTER_JUMP_ZERO        = 3;
+const int REGISTER_JUMP_NOT_ZERO    = 4;
+
 struct OpcodeDef {
     enum CodeOpcode {
         Return              = 0,
@@ -82,7 +89,9 @@ struct OpcodeDef {
         StringCompare       = 68,
         Error               = 69,
         Origin              = 70,
-        // unused: 71, 72, 73
+        CallDirect          = 71, // call a known function; callee and argument count follow
+        TailCall            = 72, // call, replacing the current function
+        TailCallDirect      = 73, // call_direct, replacing the current function
         New                 = 74,
         StringAppendUF      = 75,
         IsStatic            = 76,
@@ -99,6 +108,8 @@ struct OpcodeDef {
         GetChildren         = 87,
         GetChildCount       = 88,
         MoveTo              = 89,
+        RegisterOp          = 90, // binary operation on locals and constants
+        HeapStat            = 91, // get garbage collection and heap statistics
 
     };
 
@@ -0,0 +1,594 @@
+/* **************************************************************************
+ * Intermediate code optimizer
+ *
+ * Rewrites the intermediate code of a function before it is built into
+ * bytecode: folds operations on constant values, removes values that are
+ * pushed only to be popped again, threads jumps that lead to other jumps, and
+ * removes code that can never be reached. Finally, operations on local
+ * variables are changed to the register form of the operation.
+ *
+ * Part of GTRPE by Gren Drake
+ * **************************************************************************/
+#include <algorithm>
+#include <cstdint>
+#include <limits>
+#include <set>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "build.h"
+#include "gamedata.h"
+#include "opcode.h"
+
+typedef std::vector<AsmLine*> AsmCode;
+
+static AsmValue* asValue(AsmLine *line) {
+    return dynamic_cast<AsmValue*>(line);
+}
+
+static AsmLabel* asLabel(AsmLine *line) {
+    return dynamic_cast<AsmLabel*>(line);
+}
+
+static bool isOpcode(const AsmLine *line, int opcode) {
+    const AsmOpcode *code = dynamic_cast<const AsmOpcode*>(line);
+    return code && code->opcode == opcode;
+}
+
+static bool isConditionalJump(const AsmLine *line) {
+    return isOpcode(line, OpcodeDef::JumpZero) || isOpcode(line, OpcodeDef::JumpNotZero);
+}
+
+// Code after this line is only run if something jumps to it.
+static bool endsFlow(const AsmLine *line) {
+    if (isOpcode(line, OpcodeDef::Return) || isOpcode(line, OpcodeDef::Jump)
+            || isOpcode(line, OpcodeDef::TailCall)) {
+        return true;
+    }
+    const AsmCall *call = dynamic_cast<const AsmCall*>(line);
+    return call && call->tailCall;
+}
+
+// A value whose push has no effect beyond the stack: anything but a jump
+// target, which must still be checked against the function's labels.
+static AsmValue* asPlainValue(AsmLine *line) {
+    AsmValue *value = asValue(line);
+    if (!value || value->value.type == Value::Symbol) return nullptr;
+    return value;
+}
+
+// A value that is known when the function is built, as opposed to the
+// contents of a local variable.
+static AsmValue* asConstant(AsmLine *line) {
+    AsmValue *value = asPlainValue(line);
+    if (!value) return nullptr;
+    if (value->value.type == Value::LocalVar || value->value.type == Value::VarRef) return nullptr;
+    return value;
+}
+
+static AsmValue* asJumpTarget(AsmLine *line) {
+    AsmValue *value = asValue(line);
+    if (!value || value->value.type != Value::Symbol) return nullptr;
+    return value;
+}
+
+static bool isRegisterOpcode(int opcode) {
+    switch(opcode) {
+        case OpcodeDef::Equal:
+        case OpcodeDef::NotEqual:
+        case OpcodeDef::LessThan:
+        case OpcodeDef::LessThanEqual:
+        case OpcodeDef::GreaterThan:
+        case OpcodeDef::GreaterThanEqual:
+        case OpcodeDef::Add:
+        case OpcodeDef::Sub:
+        case OpcodeDef::Mult:
+        case OpcodeDef::Div:
+        case OpcodeDef::Mod:
+        case OpcodeDef::Pow:
+        case OpcodeDef::BitLeft:
+        case OpcodeDef::BitRight:
+        case OpcodeDef::BitAnd:
+        case OpcodeDef::BitOr:
+        case OpcodeDef::BitXor:
+            return true;
+        default:
+            return false;
+    }
+}
+
+// Get a register_op operand for a pushed value. Only locals and values of
+// the types the runner knows can be operands; register_op stores local
+// numbers in a single byte.
+static bool asOperand(AsmLine *line, AsmRegisterOp::Operand &operand) {
+    AsmValue *value = asPlainValue(line);
+    if (!value) return false;
+    if (value->value.type == Value::LocalVar) {
+        if (value->value.value < 0 || value->value.value > 255) return false;
+        operand = AsmRegisterOp::Operand{REGISTER_LOCAL, value->value};
+        return true;
+    }
+    if (value->value.type > Value::Vocab) return false;
+    operand = AsmRegisterOp::Operand{REGISTER_CONSTANT, value->value};
+    return true;
+}
+
+// These match how the runner treats values, including integer overflow
+// wrapping around.
+static bool isTrue(const Value &value) {
+    return value.type != Value::None && value.value != 0;
+}
+
+static int wrap(uint32_t value) {
+    return static_cast<int>(value);
+}
+
+static int compareValues(const Value &lhs, const Value &rhs) {
+    if (lhs.type != rhs.type) return 1;
+    switch(lhs.type) {
+        case Value::None:
+            return 0;
+        case Value::Integer:
+            return wrap(static_cast<uint32_t>(lhs.value) - static_cast<uint32_t>(rhs.value));
+        default:
+            return lhs.value == rhs.value ? 0 : 1;
+    }
+}
+
+// Fold an opcode applied to two constants, where top was pushed last.
+// Returns false if the result can't be found without running the code,
+// such as for a division by zero.
+static bool foldBinary(int opcode, const Value &lower, const Value &top, Value &result) {
+    result = Value{Value::Integer, 0};
+    switch(opcode) {
+        case OpcodeDef::Equal:
+            result.value = !compareValues(lower, top);
+            return true;
+        case OpcodeDef::NotEqual:
+            result.value = compareValues(lower, top);
+            return true;
+        case OpcodeDef::LessThan:
+            result.value = compareValues(lower, top) > 0;
+            return true;
+        case OpcodeDef::LessThanEqual:
+            result.value = compareValues(lower, top) >= 0;
+            return true;
+        case OpcodeDef::GreaterThan:
+            result.value = compareValues(lower, top) < 0;
+            return true;
+        case OpcodeDef::GreaterThanEqual:
+            result.value = compareValues(lower, top) <= 0;
+            return true;
+    }
+
+    if (lower.type != Value::Integer || top.type != Value::Integer) return false;
+    const uint32_t x = lower.value, y = top.value;
+    switch(opcode) {
+        case OpcodeDef::Add:        result.value = wrap(y + x); return true;
+        case OpcodeDef::Sub:        result.value = wrap(y - x); return true;
+        case OpcodeDef::Mult:       result.value = wrap(y * x); return true;
+        case OpcodeDef::BitAnd:     result.value = wrap(y & x); return true;
+        case OpcodeDef::BitOr:      result.value = wrap(y | x); return true;
+        case OpcodeDef::BitXor:     result.value = wrap(y ^ x); return true;
+        case OpcodeDef::Div:
+        case OpcodeDef::Mod:
+            if (lower.value == 0) return false;
+            if (lower.value == -1 && top.value == std::numeric_limits<int>::min()) return false;
+            if (opcode == OpcodeDef::Div)   result.value = top.value / lower.value;
+            else                            result.value = top.value % lower.value;
+            return true;
+        case OpcodeDef::Pow: {
+            uint32_t power = 1, base = y;
+            for (int exponent = lower.value; exponent > 0; exponent >>= 1) {
+                if (exponent & 1) power *= base;
+                base *= base;
+            }
+            result.value = wrap(power);
+            return true; }
+        case OpcodeDef::BitLeft:
+            if (lower.value < 0 || lower.value > 31) return false;
+            result.value = wrap(y << x);
+            return true;
+        case OpcodeDef::BitRight:
+            if (lower.value < 0 || lower.value > 31) return false;
+            result.value = top.value >> lower.value;
+            return true;
+    }
+    return false;
+}
+
+
+class Optimizer {
+public:
+    Optimizer(FunctionDef *function)
+    : function(function), code(function->asmCode)
+    { }
+
+    void run();
+
+private:
+    void findLabels();
+    unsigned skipLabels(unsigned position) const;
+    unsigned labelPosition(const std::string &name) const;
+    unsigned followJumps(unsigned position, AsmValue *pending, bool &usedPending) const;
+    std::string labelAt(unsigned position);
+    void remove(unsigned position);
+    void replace(unsigned position, AsmLine *line);
+    void compact();
+    bool swapsTopTwo(unsigned position);
+
+    bool foldConstants();
+    bool cancelPushPop();
+    bool threadJumps();
+    bool removeDeadCode();
+    void useRegisters();
+
+    FunctionDef *function;
+    AsmCode &code;
+    std::unordered_map<std::string, unsigned> labels;
+    std::unordered_map<std::string, unsigned> labelUses;
+};
+
+void Optimizer::run() {
+    findLabels();
+    // a jump to an undefined label is reported when the function is built,
+    // so leave the code as is rather than risk removing it
+    for (const auto &iter : labelUses) {
+        if (labels.count(iter.first) == 0) return;
+    }
+
+    bool changed = true;
+    while (changed) {
+        changed = foldConstants();
+        changed = cancelPushPop() || changed;
+        changed = threadJumps() || changed;
+        changed = removeDeadCode() || changed;
+    }
+    useRegisters();
+}
+
+void Optimizer::findLabels() {
+    labels.clear();
+    labelUses.clear();
+    for (unsigned i = 0; i < code.size(); ++i) {
+        AsmLabel *label = asLabel(code[i]);
+        if (label) {
+            labels.insert(std::make_pair(label->text, i));
+            continue;
+        }
+        AsmValue *target = asJumpTarget(code[i]);
+        if (target) ++labelUses[target->value.text];
+    }
+}
+
+unsigned Optimizer::skipLabels(unsigned position) const {
+    while (position < code.size() && asLabel(code[position])) ++position;
+    return position;
+}
+
+unsigned Optimizer::labelPosition(const std::string &name) const {
+    return skipLabels(labels.at(name));
+}
+
+// Find where execution really continues after arriving at a position by a
+// jump: through any unconditional jumps and any conditional jumps on a
+// constant. If pending is given, it was pushed just before the jump and is
+// used as the condition of the first conditional jump found. Returns the
+// original position if the jumps loop back on themselves.
+unsigned Optimizer::followJumps(unsigned position, AsmValue *pending, bool &usedPending) const {
+    const unsigned start = position;
+    std::set<unsigned> visited;
+    usedPending = false;
+    while (1) {
+        position = skipLabels(position);
+        if (!visited.insert(position).second) {
+            usedPending = false;
+            return start;
+        }
+        if (position + 1 >= code.size()) return position;
+
+        AsmValue *target = asJumpTarget(code[position]);
+        if (target && isOpcode(code[position + 1], OpcodeDef::Jump)) {
+            position = labelPosition(target->value.text);
+            continue;
+        }
+        if (target && pending && !usedPending && isConditionalJump(code[position + 1])) {
+            bool jumps = isTrue(pending->value) == isOpcode(code[position + 1], OpcodeDef::JumpNotZero);
+            position = jumps ? labelPosition(target->value.text) : position + 2;
+            usedPending = true;
+            continue;
+        }
+
+        AsmValue *condition = asConstant(code[position]);
+        if (condition) {
+            unsigned next = skipLabels(position + 1);
+            if (next + 1 < code.size() && asJumpTarget(code[next]) && isConditionalJump(code[next + 1])) {
+                bool jumps = isTrue(condition->value) == isOpcode(code[next + 1], OpcodeDef::JumpNotZero);
+                position = jumps ? labelPosition(asJumpTarget(code[next])->value.text) : next + 2;
+                continue;
+            }
+        }
+        return position;
+    }
+}
+
+// Get the name of a label at a position, adding a new label if there isn't
+// one already.
+std::string Optimizer::labelAt(unsigned position) {
+    if (position > 0) {
+        AsmLabel *label = asLabel(code[position - 1]);
+        if (label) return label->text;
+    }
+    std::string name = "__label_" + std::to_string(function->nextLabel);
+    ++function->nextLabel;
+    const Origin &origin = position < code.size() ? code[position]->getOrigin() : function->origin;
+    code.insert(code.begin() + position, new AsmLabel(origin, name));
+    findLabels();
+    return name;
+}
+
+// Removed reads of local variables still count as uses, so optimizing
+// doesn't change which unused variable warnings are given.
+void Optimizer::remove(unsigned position) {
+    AsmValue *value = asValue(code[position]);
+    if (value && (value->value.type == Value::LocalVar || value->value.type == Value::VarRef)) {
+        LocalDef *def = function->getLocal(value->value.value);
+        if (def) ++def->reads;
+    }
+    delete code[position];
+    code[position] = nullptr;
+}
+
+void Optimizer::replace(unsigned position, AsmLine *line) {
+    remove(position);
+    code[position] = line;
+}
+
+void Optimizer::compact() {
+    code.erase(std::remove(code.begin(), code.end(), nullptr), code.end());
+    findLabels();
+}
+
+bool Optimizer::foldConstants() {
+    bool changed = false;
+    for (unsigned i = 0; i + 1 < code.size(); ++i) {
+        AsmValue *first = asConstant(code[i]);
+        if (!first) continue;
+        const AsmLine *next = code[i + 1];
+
+        if (isOpcode(next, OpcodeDef::Not)) {
+            Value result{Value::Integer, !isTrue(first->value)};
+            replace(i, new AsmValue(next->getOrigin(), result));
+            remove(i + 1);
+            ++i;
+            changed = true;
+            continue;
+        }
+        if (isOpcode(next, OpcodeDef::BitNot) && first->value.type == Value::Integer) {
+            Value result{Value::Integer, ~first->value.value};
+            replace(i, new AsmValue(next->getOrigin(), result));
+            remove(i + 1);
+            ++i;
+            changed = true;
+            continue;
+        }
+
+        if (i + 2 >= code.size()) continue;
+        AsmValue *second = asConstant(code[i + 1]);
+        const AsmOpcode *opcode = dynamic_cast<const AsmOpcode*>(code[i + 2]);
+        Value result;
+        if (second && opcode && foldBinary(opcode->opcode, first->value, second->value, result)) {
+            replace(i, new AsmValue(opcode->getOrigin(), result));
+            remove(i + 1);
+            remove(i + 2);
+            i += 2;
+            changed = true;
+            continue;
+        }
+
+        // a conditional jump on a constant either always jumps or never does
+        if (asJumpTarget(code[i + 1]) && isConditionalJump(code[i + 2])) {
+            bool jumps = isTrue(first->value) == isOpcode(code[i + 2], OpcodeDef::JumpNotZero);
+            remove(i);
+            if (jumps) {
+                replace(i + 2, new AsmOpcode(code[i + 2]->getOrigin(), OpcodeDef::Jump));
+            } else {
+                remove(i + 1);
+                remove(i + 2);
+            }
+            i += 2;
+            changed = true;
+            continue;
+        }
+    }
+
+    for (unsigned i = 0; i + 2 < code.size(); ++i) {
+        // a jump on the inverse of a value is the opposite jump on the value
+        if (code[i] && isOpcode(code[i], OpcodeDef::Not)
+                && code[i + 1] && asJumpTarget(code[i + 1])
+                && code[i + 2] && isConditionalJump(code[i + 2])) {
+            int opposite = isOpcode(code[i + 2], OpcodeDef::JumpZero)
+                         ? OpcodeDef::JumpNotZero : OpcodeDef::JumpZero;
+            remove(i);
+            replace(i + 2, new AsmOpcode(code[i + 2]->getOrigin(), opposite));
+            i += 2;
+            changed = true;
+        }
+    }
+
+    if (changed) compact();
+    return changed;
+}
+
+// Check for stack_swap with the indexes of the top two items, as the list
+// and string statements use to add each item.
+bool Optimizer::swapsTopTwo(unsigned position) {
+    AsmValue *first = asConstant(code[position]);
+    AsmValue *second = asConstant(code[position + 1]);
+    if (!first || !second || !isOpcode(code[position + 2], OpcodeDef::StackSwap)) return false;
+    if (first->value.type != Value::Integer || second->value.type != Value::Integer) return false;
+    return first->value.value + second->value.value == 1
+        && (first->value.value == 0 || second->value.value == 0);
+}
+
+bool Optimizer::cancelPushPop() {
+    bool changed = false;
+    for (unsigned i = 0; i + 1 < code.size(); ++i) {
+        AsmLine *line = code[i];
+        AsmLine *next = code[i + 1];
+        if (isOpcode(next, OpcodeDef::StackPop)
+                && (asPlainValue(line) || isOpcode(line, OpcodeDef::PushNone)
+                    || isOpcode(line, OpcodeDef::StackDup))) {
+            remove(i);
+            remove(i + 1);
+            ++i;
+            changed = true;
+            continue;
+        }
+
+        // swapping the top two stack items right after pushing them is the
+        // same as pushing them in the other order
+        if (i + 4 < code.size() && swapsTopTwo(i + 2)) {
+            if (asPlainValue(line) && asPlainValue(next)) {
+                std::swap(code[i], code[i + 1]);
+                remove(i + 2);
+                remove(i + 3);
+                remove(i + 4);
+                i += 4;
+                changed = true;
+            } else if (isOpcode(line, OpcodeDef::StackDup) && asPlainValue(next)) {
+                // duplicating an item, then swapping it with a new value
+                // pushed on top, is the same as peeking at the item after
+                // pushing the value
+                const Origin origin = code[i + 4]->getOrigin();
+                remove(i);
+                replace(i + 2, new AsmValue(origin, Value{Value::Integer, 1}));
+                replace(i + 3, new AsmOpcode(origin, OpcodeDef::StackPeek));
+                remove(i + 4);
+                i += 4;
+                changed = true;
+            }
+        }
+    }
+    if (changed) compact();
+    return changed;
+}
+
+bool Optimizer::threadJumps() {
+    for (unsigned i = 0; i + 1 < code.size(); ++i) {
+        AsmValue *target = asJumpTarget(code[i]);
+        if (!target) continue;
+        const bool isJump = isOpcode(code[i + 1], OpcodeDef::Jump);
+        if (!isJump && !isConditionalJump(code[i + 1])) continue;
+
+        AsmValue *pending = isJump && i > 0 ? asConstant(code[i - 1]) : nullptr;
+        bool usedPending = false;
+        const unsigned oldPosition = labelPosition(target->value.text);
+        const unsigned newPosition = followJumps(oldPosition, pending, usedPending);
+
+        // jumping to the code that follows anyway does nothing, except that
+        // a conditional jump still removes its condition
+        if (newPosition == skipLabels(i + 2)) {
+            if (isJump) {
+                if (usedPending) remove(i - 1);
+                remove(i);
+                remove(i + 1);
+            } else {
+                remove(i);
+                replace(i + 1, new AsmOpcode(code[i + 1]->getOrigin(), OpcodeDef::StackPop));
+            }
+            compact();
+            return true;
+        }
+
+        if (newPosition != oldPosition) {
+            target->value.text = labelAt(newPosition);
+            if (usedPending) {
+                // adding the label may have moved the pending value
+                remove(std::find(code.begin(), code.end(), pending) - code.begin());
+                compact();
+            } else {
+                findLabels();
+            }
+            return true;
+        }
+    }
+    return false;
+}
+
+// Remove anything after a return or unconditional jump up to the next label
+// that something jumps to, along with labels nothing jumps to.
+bool Optimizer::removeDeadCode() {
+    bool changed = false;
+    bool reachable = true;
+    for (unsigned i = 0; i < code.size(); ++i) {
+        AsmLabel *label = asLabel(code[i]);
+        if (label) {
+            if (labelUses.count(label->text) == 0) {
+                remove(i);
+                changed = true;
+            } else {
+                reachable = true;
+            }
+            continue;
+        }
+        if (!reachable) {
+            remove(i);
+            changed = true;
+            continue;
+        }
+        if (endsFlow(code[i])) {
+            reachable = false;
+        }
+    }
+    if (changed) compact();
+    return changed;
+}
+
+// Replace binary operations on locals and constants, or whose result is
+// stored in a local or decides a jump, with register_op, which does the same
+// without going through the stack. This is done after the other passes since
+// they only understand the stack form of the code.
+void Optimizer::useRegisters() {
+    const AsmRegisterOp::Operand onStack{REGISTER_STACK, Value{Value::None}};
+    bool changed = false;
+    for (unsigned i = 0; i < code.size(); ++i) {
+        const AsmOpcode *op = dynamic_cast<const AsmOpcode*>(code[i]);
+        if (!op || !isRegisterOpcode(op->opcode)) continue;
+
+        // the operand pushed last must be taken first
+        AsmRegisterOp::Operand top = onStack, lower = onStack, result = onStack;
+        unsigned first = i;
+        if (first > 0 && asOperand(code[first - 1], top)) {
+            --first;
+            if (first > 0 && asOperand(code[first - 1], lower)) --first;
+        }
+
+        unsigned last = i;
+        AsmValue *next = i + 2 < code.size() ? asValue(code[i + 1]) : nullptr;
+        if (next && next->value.type == Value::VarRef && isOpcode(code[i + 2], OpcodeDef::Store)
+                && next->value.value >= 0 && next->value.value <= 255) {
+            result = AsmRegisterOp::Operand{REGISTER_LOCAL, next->value};
+            last = i + 2;
+        } else if (next && asJumpTarget(next) && isConditionalJump(code[i + 2])) {
+            int kind = isOpcode(code[i + 2], OpcodeDef::JumpZero) ? REGISTER_JUMP_ZERO
+                                                                  : REGISTER_JUMP_NOT_ZERO;
+            result = AsmRegisterOp::Operand{kind, next->value};
+            last = i + 2;
+        }
+        if (first == i && last == i) continue;
+
+        AsmLine *registerOp = new AsmRegisterOp(op->getOrigin(), op->opcode, result, top, lower);
+        for (unsigned j = first; j <= last; ++j) remove(j);
+        code[first] = registerOp;
+        i = last;
+        changed = true;
+    }
+    if (changed) compact();
+}
+
+void optimize_function(FunctionDef *function) {
+    Optimizer optimizer(function);
+    optimizer.run();
+}
@@ -2,7 +2,8 @@
  * Origin Class Definition
  *
  * This Origin class is used to store the source file location something came
- * from.
+ * from. Files are referred to by their index in the list of source files,
+ * which keeps every source file read during the build.
  *
  * Part of GTRPE by Gren Drake
  * **************************************************************************/
@@ -10,19 +11,41 @@
 #ifndef ORIGIN_H
 #define ORIGIN_H
 
+#include <deque>
 #include <string>
 
+struct SourceFile {
+    std::string name;
+    std::string text;
+    // text of string literals that needed escapes handled and so can't
+    // refer into the source text
+    std::deque<std::string> strings;
+};
+
+// Source files are kept until the builder exits, so tokens may refer to
+// their text. These are safe to call from several threads at once, but each
+// file's text and strings should only be changed by one thread.
+unsigned addSourceFile(const std::string &name, std::string &&text);
+unsigned getSourceFileIndex(const std::string &name);
+SourceFile& getSourceFile(unsigned index);
+
 class Origin {
 public:
     Origin()
-    : file("(internal)"), fileNameString(-1), line(0), column(0)
+    : fileIndex(0), line(0), column(0)
+    { }
+    Origin(unsigned fileIndex, int line, int column)
+    : fileIndex(fileIndex), line(line), column(column)
     { }
     Origin(const std::string &file, int line, int column)
-    : file(file), fileNameString(-1), line(line), column(column)
+    : fileIndex(getSourceFileIndex(file)), line(line), column(column)
     { }
 
-    std::string file;
-    int fileNameString;
+    const std::string& file() const {
+        return getSourceFile(fileIndex).name;
+    }
+
+    unsigned fileIndex;
     int line, column;
 };
 
@@ -7,7 +7,10 @@
  * Part of GTRPE by Gren Drake
  * **************************************************************************/
 #include <algorithm>
+#include <exception>
+#include <initializer_list>
 #include <map>
+#include <unordered_map>
 #include <sstream>
 #include <string>
 #include <vector>
@@ -19,13 +22,15 @@
 #include "origin.h"
 #include "token.h"
 #include "opcode.h"
+#include "cache.h"
 #include "expression.h"
+#include "threadpool.h"
 
 #include "bytestream.h"
 
-void parse_std_function(GameData &gamedata, FunctionDef *function, ParseState &state);
+void parse_std_function(GameData &gamedata, FunctionDef *function, ParseState &state, bool optimize);
 static int bytecode_push_value(ByteStream &bytecode, Value::Type type, int32_t value);
-void build_function(FunctionDef *function);
+void build_function(GameData &gamedata, FunctionDef *function, bool optimize);
 
 ListValue parse_listvalue(GameData &gamedata, FunctionDef *function, ParseState &state);
 List* parse_list(GameData &gamedata, FunctionDef *function, ParseState &state);
@@ -96,8 +101,9 @@ Value evalIdentifier(GameData &gamedata, FunctionDef *function, const std::strin
     }
 
     // is global symbol
-    const SymbolDef *symbol = gamedata.symbols.get(identifier, true);
+    const SymbolDef *symbol = gamedata.symbols.get(identifier);
     if (symbol) {
+        function->symbolUses.push_back(symbol);
         return symbol->value;
     }
 
@@ -122,11 +128,11 @@ ListValue parse_listvalue(GameData &gamedata, FunctionDef *function, ParseState
             newValue = ListValue{here->origin,  Value{Value::Property, here->value} };
             break;
         case Token::String: {
-            int ident = gamedata.getStringId(state.here()->text);
+            int ident = gamedata.getStringId(state.here()->text());
             newValue = ListValue{here->origin,  Value{Value::String, ident} };
             break; }
         case Token::Vocab: {
-            int ident = gamedata.getVocabNumber(state.here()->text);
+            int ident = gamedata.getVocabNumber(state.here()->text());
             newValue = ListValue{here->origin,  Value{Value::Vocab, ident} };
             break; }
         case Token::OpenParan: {
@@ -134,7 +140,7 @@ ListValue parse_listvalue(GameData &gamedata, FunctionDef *function, ParseState
             newValue = ListValue{here->origin,  Value{Value::Expression}, sublist };
             break; }
         case Token::Identifier: {
-            Value result = evalIdentifier(gamedata, function, here->text);
+            Value result = evalIdentifier(gamedata, function, here->text());
             newValue = ListValue{here->origin,  result };
             break; }
         case Token::Indirection:
@@ -198,12 +204,46 @@ void FunctionBuilder::build(const AsmLabel *label) {
 void FunctionBuilder::build(const AsmOpcode *opcode) {
     forFunction->code.add_8(opcode->opcode);
 }
+void FunctionBuilder::build(const AsmCall *call) {
+    forFunction->code.add_8(call->tailCall ? OpcodeDef::TailCallDirect : OpcodeDef::CallDirect);
+    forFunction->code.add_32(call->functionId);
+    forFunction->code.add_8(call->argumentCount);
+    forFunction->code.add_8(call->checkTypes);
+}
+void FunctionBuilder::build(const AsmRegisterOp *op) {
+    ByteStream &code = forFunction->code;
+    code.add_8(OpcodeDef::RegisterOp);
+    code.add_8(op->opcode);
+    for (const AsmRegisterOp::Operand *operand : { &op->result, &op->top, &op->lower }) {
+        code.add_8(operand->kind);
+        switch(operand->kind) {
+            case REGISTER_LOCAL:
+                code.add_8(operand->value.value);
+                break;
+            case REGISTER_CONSTANT:
+                code.add_8(operand->value.type);
+                code.add_32(operand->value.value);
+                break;
+            case REGISTER_JUMP_ZERO:
+            case REGISTER_JUMP_NOT_ZERO: {
+                auto labelIter = forFunction->labels.find(operand->value.text);
+                if (labelIter != forFunction->labels.end()) {
+                    code.add_32(labelIter->second);
+                } else {
+                    patches.push_back(Backpatch{code.size(), operand->value.text, op->getOrigin()});
+                    code.add_32(0xFFFFFFFF);
+                }
+                break; }
+        }
+    }
+}
 
-void build_function(GameData &gamedata, FunctionDef *function) {
+void build_function(GameData &gamedata, FunctionDef *function, bool optimize) {
     FunctionBuilder builder{function, gamedata};
 
     function->addValue(function->origin, Value{Value::Integer, 0});
     function->addOpcode(function->origin, OpcodeDef::Return);
+    if (optimize) optimize_function(function);
     for (const AsmLine *line : function->asmCode) {
         line->build(builder);
     }
@@ -220,7 +260,7 @@ void build_function(GameData &gamedata, FunctionDef *function) {
     }
 }
 
-void parse_std_function(GameData &gamedata, FunctionDef *function, ParseState &state) {
+void parse_std_function(GameData &gamedata, FunctionDef *function, ParseState &state, bool optimize) {
     std::vector<List*> lists;
 
     while (!state.at_end()) {
@@ -234,42 +274,197 @@ void parse_std_function(GameData &gamedata, FunctionDef *function, ParseState &s
         process_list(gamedata, function, l);
         function->addOpcode(function->origin, OpcodeDef::StackPop);
     }
-    build_function(gamedata, function);
+    build_function(gamedata, function, optimize);
 
     for (List *l : lists) {
         delete l;
     }
 }
 
-int parse_functions(GameData &gamedata) {
-    for (FunctionDef *function : gamedata.functions) {
+// Compile a single function into its own ByteStream. This runs on a pool
+// thread, so it may only read from gamedata; errors go to the caller's
+// ErrorBuffer.
+static void compile_function(GameData &gamedata, FunctionDef *function, bool optimize) {
+    ParseState state = {
+        gamedata,
+        function->tokens,
+        function->tokens.cbegin()
+    };
+
+    for (std::vector<LocalDef>::size_type i = 0; i < function->locals.size(); ++i) {
+        if (nameInUse(gamedata, function, function->locals[i].name, i)) {
+            std::stringstream ss;
+            ss << "Local name \"" << function->locals[i].name << "\" already in use.";
+            gamedata.addError(function->origin, ErrorMsg::Error, ss.str());
+        }
+    }
+
+    parse_std_function(gamedata, function, state, optimize);
+    function->code.padTo(4);
+
+    for (const LocalDef &def : function->locals) {
+        if (def.reads == 0) {
+            gamedata.addError(function->origin, ErrorMsg::Warning, "Local variable " + def.name + " not used.");
+        }
+    }
+}
+
+// Hash everything the compiled code for a function depends on: its locals,
+// its tokens, and what each of those tokens resolves to in the rest of the
+// game. Any change to these gives a different key, so cached code found
+// under a key is the same code compiling the function would produce.
+static uint64_t function_key(GameData &gamedata, const FunctionDef *function, bool optimize) {
+    Hasher hasher;
+    hasher.add_32(optimize);
+    hasher.add(function->origin.file());
+    hasher.add_32(function->origin.line);
+    hasher.add_32(function->origin.column);
+    hasher.add_32(function->isAsm);
+    hasher.add_32(function->argument_count);
+    hasher.add_32(function->locals.size());
+    for (const LocalDef &local : function->locals) {
+        hasher.add(local.name);
+        hasher.add_32(local.type);
+        hasher.add_32(gamedata.symbols.get(local.name) != nullptr);
+    }
+    hasher.add_32(function->tokens.size());
+    for (const Token &token : function->tokens) {
+        hasher.add_32(token.type);
+        hasher.add_32(token.textLength);
+        hasher.add(token.textStart, token.textLength);
+        hasher.add_32(token.value);
+        hasher.add_32(token.origin.line);
+        hasher.add_32(token.origin.column);
+        switch(token.type) {
+            case Token::Identifier: {
+                const SymbolDef *symbol = gamedata.symbols.get(token.text());
+                hasher.add_32(symbol != nullptr);
+                if (symbol) {
+                    hasher.add_32(symbol->value.type);
+                    hasher.add_32(symbol->value.value);
+                    hasher.add(symbol->value.text);
+                    // calls to known functions check their arguments
+                    // against the argument types of the callee
+                    if (symbol->value.type == Value::Function) {
+                        const FunctionDef *callee = gamedata.functionById(symbol->value.value);
+                        if (callee) {
+                            hasher.add_32(callee->argument_count);
+                            for (int i = 0; i < callee->argument_count; ++i) {
+                                hasher.add_32(callee->locals[i].type);
+                            }
+                        }
+                    }
+                }
+                break; }
+            case Token::String:
+                hasher.add_32(gamedata.getStringId(token.text()));
+                break;
+            case Token::Vocab:
+                hasher.add_32(gamedata.getVocabNumber(token.text()));
+                break;
+            default:
+                break;
+        }
+    }
+    return hasher.hash();
+}
+
+struct CompiledFunction {
+    CompiledFunction()
+    : key(0), cached(nullptr)
+    { }
+
+    std::vector<ErrorMsg> errors;
+    std::exception_ptr error;
+    uint64_t key;
+    const CachedFunction *cached;
+};
+
+int parse_functions(GameData &gamedata, int threadCount, bool optimize, BuildCache *cache) {
+    // intern every string literal up front, in the same order compiling
+    // the functions one after another would, so the string ids don't
+    // depend on which thread gets to a string first
+    for (const FunctionDef *function : gamedata.functions) {
         if (function == nullptr) continue;
-        ParseState state = {
-            gamedata,
-            function->tokens,
-            function->tokens.cbegin()
-        };
-
-        for (std::vector<LocalDef>::size_type i = 0; i < function->locals.size(); ++i) {
-            if (nameInUse(gamedata, function, function->locals[i].name, i)) {
-                std::stringstream ss;
-                ss << "Local name \"" << function->locals[i].name << "\" already in use.";
-                gamedata.addError(function->origin, ErrorMsg::Error, ss.str());
+        for (const Token &token : function->tokens) {
+            if (token.type == Token::String) {
+                gamedata.getStringId(token.text());
             }
         }
+    }
+    if (cache) cache->loadFunctions();
 
-        function->codePosition = gamedata.bytecode.size();
-        parse_std_function(gamedata, function, state);
-        function->code.padTo(4);
-        gamedata.bytecode.append(function->code);
-        function->codeEndPosition = gamedata.bytecode.size();
+    std::vector<CompiledFunction> results(gamedata.functions.size());
+    {
+        ThreadPool pool(threadCount);
+        for (unsigned i = 0; i < gamedata.functions.size(); ++i) {
+            FunctionDef *function = gamedata.functions[i];
+            if (function == nullptr) continue;
+            CompiledFunction *result = &results[i];
+            pool.submit([&gamedata, function, result, optimize, cache]{
+                if (cache) {
+                    result->key = function_key(gamedata, function, optimize);
+                    result->cached = cache->getFunction(result->key);
+                    if (result->cached) {
+                        for (uint8_t byte : result->cached->code) {
+                            function->code.add_8(byte);
+                        }
+                        result->errors = result->cached->warnings;
+                        return;
+                    }
+                }
+                ErrorBuffer buffer;
+                try {
+                    compile_function(gamedata, function, optimize);
+                } catch (...) {
+                    result->error = std::current_exception();
+                }
+                result->errors = std::move(buffer.errors);
+            });
+        }
+        pool.wait();
+    }
+
+    // lay out the code and report errors in function order
+    std::unordered_map<uint64_t, CachedFunction> cachedFunctions;
+    for (unsigned i = 0; i < gamedata.functions.size(); ++i) {
+        FunctionDef *function = gamedata.functions[i];
+        if (function == nullptr) continue;
+        CompiledFunction &result = results[i];
+        for (const ErrorMsg &msg : result.errors) {
+            gamedata.addError(msg.origin, msg.type, msg.message);
+        }
+        if (result.error) std::rethrow_exception(result.error);
 
-        for (const LocalDef &def : function->locals) {
-            if (def.reads == 0) {
-                gamedata.addError(function->origin, ErrorMsg::Warning, "Local variable " + def.name + " not used.");
+        if (result.cached) {
+            for (const std::string &name : result.cached->symbolUses) {
+                gamedata.symbols.markUsed(name);
+            }
+            cachedFunctions.insert(std::make_pair(result.key, *result.cached));
+        } else {
+            CachedFunction newEntry;
+            for (const SymbolDef *symbol : function->symbolUses) {
+                gamedata.symbols.markUsed(symbol->name);
+                newEntry.symbolUses.push_back(symbol->name);
+            }
+            if (cache) {
+                for (unsigned j = 0; j < function->code.size(); ++j) {
+                    newEntry.code.push_back(function->code.read_8(j));
+                }
+                newEntry.warnings = result.errors;
+                cachedFunctions.insert(std::make_pair(result.key, std::move(newEntry)));
             }
         }
+
+        function->codePosition = gamedata.bytecode.size();
+        gamedata.bytecode.append(function->code);
+        function->codeEndPosition = gamedata.bytecode.size();
+    }
+    // a failed build is compiled again next time so the errors are
+    // reported again
+    if (cache && !gamedata.hasErrors()) {
+        cache->saveFunctions(std::move(cachedFunctions));
     }
 
     return 1;
-}
\ No newline at end of file
+}
@@ -48,7 +48,7 @@ void parse_constant(GameData &gamedata, ParseState &state) {
         state.next();
         return;
     }
-    const std::string &constantName = state.here()->text;
+    const std::string &constantName = state.here()->text();
     state.next();
     Value value = parse_value(gamedata, state, constantName);
     if (value.type == Value::Object || value.type == Value::Function) {
@@ -78,7 +78,7 @@ static void parse_default(GameData &gamedata, ParseState &state) {
         state.next();
         return;
     }
-    const std::string &defaultName = state.here()->text;
+    const std::string &defaultName = state.here()->text();
     state.next();
     Value value = parse_value(gamedata, state, defaultName);
     if (value.type == Value::Object || value.type == Value::Function) {
@@ -125,7 +125,7 @@ static void parse_extend(GameData &gamedata, ParseState &state) {
     }
 
     Value::Type oldType = Value::None;
-    const std::string &oldName = state.here()->text;
+    const std::string &oldName = state.here()->text();
     const SymbolDef *old = gamedata.symbols.get(oldName);
     if (!old) {
         gamedata.addError(origin, ErrorMsg::Error, "Can only extend existing values.");
@@ -261,7 +261,7 @@ int parse_flags(GameData &gamedata, ParseState &state) {
         if (state.here()->type == Token::Integer) {
             flagset.values.push_back(Value{Value::Integer, state.here()->value});
         } else if (state.here()->type == Token::Identifier) {
-            flagset.values.push_back(Value{Value::Symbol, 0, state.here()->text});
+            flagset.values.push_back(Value{Value::Symbol, 0, state.here()->text()});
         } else {
             std::stringstream ss;
             ss << "Invalid token " << state.here()->type << " in flags.";
@@ -283,7 +283,7 @@ int parse_function(GameData &gamedata, ParseState &state, const std::string &def
 
     std::string funcName;
     if (state.matches(Token::Identifier)) {
-        funcName = state.here()->text;
+        funcName = state.here()->text();
         gamedata.symbols.add(origin, SymbolDef(origin,
                                         funcName,
                                         Value{Value::Function, nextDataId}));
@@ -302,12 +302,12 @@ int parse_function(GameData &gamedata, ParseState &state, const std::string &def
 
     FunctionDef *function = new FunctionDef;
     function->origin = origin;
-    function->origin.fileNameString = gamedata.getStringId(origin.file);
+    function->fileNameString = gamedata.getStringId(origin.file());
     function->name = funcName;
     function->nameString = gamedata.getStringId(funcName);
     function->globalId = nextDataId++;
     function->isAsm = isAsm;
-    gamedata.functions.push_back(function);
+    gamedata.addFunction(function);
     // hidden "self" argument
     ++function->argument_count;
     function->addLocal("self", Value::Any, true);
@@ -321,16 +321,16 @@ int parse_function(GameData &gamedata, ParseState &state, const std::string &def
             continue;
         }
         ++function->argument_count;
-        const std::string &name = state.here()->text;
+        const std::string &name = state.here()->text();
         state.next();
         Value::Type type = Value::Any;
         if (state.matches(Token::Colon)) {
             state.next();
             state.require(Token::Identifier);
-            const SymbolDef *s = gamedata.symbols.get(state.here()->text);
+            const SymbolDef *s = gamedata.symbols.get(state.here()->text());
             if (!s || s->value.type != Value::TypeId) {
                 std::stringstream ss;
-                ss << state.here()->text << " is not a valid type.";
+                ss << state.here()->text() << " is not a valid type.";
                 gamedata.addError(state.here()->origin, ErrorMsg::Error, ss.str());
             } else {
                 type = static_cast<Value::Type>(s->value.value);
@@ -352,7 +352,7 @@ int parse_function(GameData &gamedata, ParseState &state, const std::string &def
                 continue;
             }
             ++function->local_count;
-            function->addLocal(state.here()->text, Value::Any, false);
+            function->addLocal(state.here()->text(), Value::Any, false);
             state.next();
         }
         state.next();
@@ -379,7 +379,7 @@ int parse_list(GameData &gamedata, ParseState &state) {
     GameList *list = new GameList;
     gamedata.lists.push_back(list);
     list->origin = origin;
-    list->origin.fileNameString = gamedata.getStringId(origin.file);
+    list->fileNameString = gamedata.getStringId(origin.file());
     list->globalId = nextDataId++;
     while (!state.matches(Token::CloseSquare)) {
         if (state.eof()) {
@@ -403,7 +403,7 @@ int parse_map(GameData &gamedata, ParseState &state) {
     GameMap *map = new GameMap;
     gamedata.maps.push_back(map);
     map->origin = origin;
-    map->origin.fileNameString = gamedata.getStringId(origin.file);
+    map->fileNameString = gamedata.getStringId(origin.file());
     map->globalId = nextDataId++;
     state.skip(Token::OpenBrace);
     while (!state.matches(Token::CloseBrace)) {
@@ -438,7 +438,7 @@ void parse_objectProperty(GameData &gamedata, ParseState &state, GameObject *obj
     try {
         state.require(Token::Property);
         propId = state.here()->value;
-        propName = state.here()->text;
+        propName = state.here()->text();
     } catch (BuildError &e) {
         gamedata.addError(e.getOrigin(), ErrorMsg::Error, e.getMessage());
         propId = -1;
@@ -475,7 +475,7 @@ int parse_object(GameData &gamedata, ParseState &state, const std::string &defau
     std::string prototypeName = "";
     std::string parentName = "";
     if (state.matches(Token::Identifier)) {
-        objectName = state.here()->text;
+        objectName = state.here()->text();
         state.next();
     } else {
         objectName = defaultName;
@@ -483,25 +483,25 @@ int parse_object(GameData &gamedata, ParseState &state, const std::string &defau
     if (state.matches(Token::Colon)) {
         state.next();
         state.require(Token::Identifier);
-        prototypeName = state.here()->text;
+        prototypeName = state.here()->text();
         state.next();
     }
     if (state.matches(Token::AtSymbol)) {
         state.next();
         state.require(Token::Identifier);
-        parentName = state.here()->text;
+        parentName = state.here()->text();
         state.next();
     }
 
     GameObject *object = new GameObject;
     object->origin = origin;
-    object->origin.fileNameString = gamedata.getStringId(origin.file);
+    object->fileNameString = gamedata.getStringId(origin.file());
     object->name = objectName;
     object->nameString = gamedata.getStringId(objectName);
     object->globalId = nextDataId++;
     object->parentName = parentName;
     object->parentId = object->childId = object->siblingId = 0;
-    gamedata.objects.push_back(object);
+    gamedata.addObject(object);
     if (!objectName.empty()) {
         if (validSymbol(objectName)) {
             gamedata.symbols.add(origin, SymbolDef(origin,
@@ -561,15 +561,15 @@ Value parse_value(GameData &gamedata, ParseState &state, const std::string &defa
         value = Value{Value::Property, newId};
         state.next();
     } else if (state.matches(Token::String)) {
-        int newId = gamedata.getStringId(state.here()->text);
+        int newId = gamedata.getStringId(state.here()->text());
         value = Value{Value::String, newId};
         state.next();
     } else if (state.matches(Token::Vocab)) {
-        int newId = gamedata.getVocabNumber(state.here()->text);
+        int newId = gamedata.getVocabNumber(state.here()->text());
         value = Value{Value::Vocab, newId};
         state.next();
     } else if (state.matches(Token::Identifier)) {
-        value = Value{Value::Symbol, 0, state.here()->text};
+        value = Value{Value::Symbol, 0, state.here()->text()};
         state.next();
     } else if (state.matches(Token::OpenSquare)) {
         int newId = parse_list(gamedata, state);
@@ -633,7 +633,7 @@ int parse_tokens(GameData &gamedata, const std::vector<Token> &tokens) {
         } else {
             const Token *token = state.here();
             std::stringstream ss;
-            ss << "Unexpected top level directive " << token->text << ".";
+            ss << "Unexpected top level directive " << token->text() << ".";
             gamedata.addError(token->origin, ErrorMsg::Error, ss.str());
             state.next();
         }
@@ -44,7 +44,7 @@ bool ParseState::matches(const std::string &text) const {
     const Token *token = here();
     if (!token) return false;
     if (token->type != Token::Identifier) return false;
-    return token->text == text;
+    return token->textEquals(text);
 }
 
 void ParseState::require(Token::Type type) const {
@@ -68,13 +68,13 @@ void ParseState::skip(Token::Type type) {
 
 void ParseState::skip(const std::string &text) {
     require(Token::Identifier);
-    if (here()->text == text) {
+    if (here()->textEquals(text)) {
         next();
         return;
     }
     std::stringstream ss;
     ss << " Expected identifier ~" << text << "~, but found ~";
-    ss << here()->text << "~.";
+    ss << here()->text() << "~.";
     throw BuildError(here()->origin, ss.str());
 }
 
@@ -1,8 +1,9 @@
 #ifndef SYMBOLTABLE_H
 #define SYMBOLTABLE_H
 
+#include <deque>
 #include <string>
-#include <vector>
+#include <unordered_map>
 
 #include "origin.h"
 #include "value.h"
@@ -27,7 +28,11 @@ public:
     void add(const Origin &definingAt, const SymbolDef &symbol);
     const SymbolDef* get(const std::string &name, bool countsAsUse = false);
     void markUsed(const std::string &name);
-    std::vector<SymbolDef> symbols;
+    // symbols in the order they were defined; a deque so adding symbols
+    // never moves the existing ones
+    std::deque<SymbolDef> symbols;
+private:
+    std::unordered_map<std::string, SymbolDef*> mIndex;
 };
 
 std::ostream& operator<<(std::ostream &out, const SymbolDef::Type &type);
@@ -37,24 +37,31 @@ public:
     };
 
     Token()
-    : type(Integer), value(0)
+    : type(Integer), textStart(""), textLength(0), value(0)
     { }
     Token(const Origin &origin, Type type)
-    : origin(origin), type(type), value(0)
-    { }
-    Token(const Origin &origin, Type type, const std::string &text)
-    : origin(origin), type(type), text(text), value(0)
+    : origin(origin), type(type), textStart(""), textLength(0), value(0)
     { }
     Token(const Origin &origin, Type type, int value)
-    : origin(origin), type(type), value(value)
+    : origin(origin), type(type), textStart(""), textLength(0), value(value)
     { }
-    Token(const Origin &origin, Type type, const std::string &text, int value)
-    : origin(origin), type(type), text(text), value(value)
+    Token(const Origin &origin, Type type, const char *textStart, unsigned textLength, int value = 0)
+    : origin(origin), type(type), textStart(textStart), textLength(textLength), value(value)
     { }
 
+    std::string text() const {
+        return std::string(textStart, textLength);
+    }
+    bool textEquals(const std::string &other) const {
+        return other.size() == textLength && other.compare(0, textLength, textStart, textLength) == 0;
+    }
+
     Origin origin;
     Type type;
-    std::string text;
+    // the token's text isn't copied, but refers to the text of the source
+    // file it came from (see SourceFile in origin.h)
+    const char *textStart;
+    unsigned textLength;
     int value;
 };
 
@@ -42,8 +42,16 @@ void add_default_constants(GameData &gamedata) {
 
 void translate_value(GameData &gamedata, Value &value) {
     if (value.type == Value::FlagSet) {
+        // flag sets share the data id sequence with lists and maps, so the
+        // value is an ident, not a position in gamedata.flagsets
+        const FlagSet *flagset = gamedata.flagSetById(value.value);
+        if (!flagset) {
+            std::stringstream ss;
+            ss << "Undefined flag set #" << value.value << '.';
+            throw BuildError(ss.str());
+        }
         value.type = Value::Integer;
-        value.value = gamedata.flagsets[value.value].finalValue;
+        value.value = flagset->finalValue;
         return;
     }
     if (value.type != Value::Symbol) return;
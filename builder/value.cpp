@@ -50,6 +50,9 @@ std::ostream& operator<<(std::ostream &out, const Value::Type &type) {
         case Value::VarRef:
             out << "VarRef";
             break;
+        case Value::Vocab:
+            out << "Vocab";
+            break;
         case Value::JumpTarget:
             out << "Jump Target";
             break;
@@ -0,0 +1,98 @@
+#include "threadpool.h"
+
+// the index of the pool worker running on this thread, if any
+static thread_local int currentWorker = -1;
+
+ThreadPool::ThreadPool(int threadCount)
+: mNextWorker(0), mQueuedTasks(0), mPendingTasks(0), mStopping(false)
+{
+    if (threadCount < 1) threadCount = 1;
+    for (int i = 0; i < threadCount; ++i) {
+        mWorkers.push_back(std::unique_ptr<Worker>(new Worker));
+    }
+    for (int i = 0; i < threadCount; ++i) {
+        mThreads.push_back(std::thread(&ThreadPool::run, this, i));
+    }
+}
+
+ThreadPool::~ThreadPool() {
+    {
+        std::lock_guard<std::mutex> lock(mSleepMutex);
+        mStopping = true;
+    }
+    mWakeup.notify_all();
+    for (std::thread &thread : mThreads) {
+        thread.join();
+    }
+}
+
+void ThreadPool::submit(Task task) {
+    // tasks submitted from inside the pool stay on the same worker; others
+    // are spread over the workers in turn
+    unsigned index = currentWorker >= 0 ? currentWorker
+                                        : mNextWorker++ % mWorkers.size();
+    {
+        std::lock_guard<std::mutex> lock(mSleepMutex);
+        ++mPendingTasks;
+    }
+    {
+        std::lock_guard<std::mutex> lock(mWorkers[index]->mutex);
+        mWorkers[index]->tasks.push_back(std::move(task));
+    }
+    {
+        std::lock_guard<std::mutex> lock(mSleepMutex);
+        ++mQueuedTasks;
+    }
+    mWakeup.notify_one();
+}
+
+void ThreadPool::wait() {
+    std::unique_lock<std::mutex> lock(mSleepMutex);
+    mIdle.wait(lock, [this]{ return mPendingTasks == 0; });
+}
+
+bool ThreadPool::popTask(unsigned index, Task &task) {
+    {
+        Worker &own = *mWorkers[index];
+        std::lock_guard<std::mutex> lock(own.mutex);
+        if (!own.tasks.empty()) {
+            task = std::move(own.tasks.back());
+            own.tasks.pop_back();
+            return true;
+        }
+    }
+    for (unsigned i = 1; i < mWorkers.size(); ++i) {
+        Worker &victim = *mWorkers[(index + i) % mWorkers.size()];
+        std::lock_guard<std::mutex> lock(victim.mutex);
+        if (!victim.tasks.empty()) {
+            task = std::move(victim.tasks.front());
+            victim.tasks.pop_front();
+            return true;
+        }
+    }
+    return false;
+}
+
+void ThreadPool::run(unsigned index) {
+    currentWorker = index;
+    while (1) {
+        Task task;
+        if (popTask(index, task)) {
+            {
+                std::lock_guard<std::mutex> lock(mSleepMutex);
+                --mQueuedTasks;
+            }
+            task();
+            std::lock_guard<std::mutex> lock(mSleepMutex);
+            --mPendingTasks;
+            if (mPendingTasks == 0) mIdle.notify_all();
+            continue;
+        }
+
+        std::unique_lock<std::mutex> lock(mSleepMutex);
+        if (mStopping && mQueuedTasks <= 0) return;
+        // a task may have been queued between checking the queues and
+        // taking the lock, so only sleep while nothing is waiting to run
+        mWakeup.wait(lock, [this]{ return mStopping || mQueuedTasks > 0; });
+    }
+}
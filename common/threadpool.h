@@ -0,0 +1,45 @@
+#ifndef THREADPOOL_H
+#define THREADPOOL_H
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// A fixed set of worker threads, each with its own queue of tasks. Workers
+// run tasks from the back of their own queue and, once it is empty, steal
+// from the front of the other workers' queues.
+class ThreadPool {
+public:
+    typedef std::function<void()> Task;
+
+    ThreadPool(int threadCount);
+    ~ThreadPool();
+
+    void submit(Task task);
+    void wait();
+
+private:
+    struct Worker {
+        std::mutex mutex;
+        std::deque<Task> tasks;
+    };
+
+    void run(unsigned index);
+    bool popTask(unsigned index, Task &task);
+
+    std::vector<std::unique_ptr<Worker>> mWorkers;
+    std::vector<std::thread> mThreads;
+    std::mutex mSleepMutex;
+    std::condition_variable mWakeup, mIdle;
+    std::atomic<unsigned> mNextWorker;
+    int mQueuedTasks;   // submitted but not yet started
+    int mPendingTasks;  // submitted but not yet finished
+    bool mStopping;
+};
+
+#endif
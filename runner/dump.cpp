@@ -16,9 +16,21 @@ void dump_string(const std::string &text) {
     }
 }
 
+// Gather the current version of every item, static or dynamic, in ident order.
+template<class T>
+static std::map<int, const T*> allItems(const std::map<int, std::shared_ptr<T>> &items,
+                                        const std::vector<std::shared_ptr<const T>> &statics) {
+    std::map<int, const T*> result;
+    for (unsigned i = 0; i < statics.size(); ++i) {
+        if (statics[i]) result[i] = statics[i].get();
+    }
+    for (const auto &def : items) result[def.first] = def.second.get();
+    return result;
+}
+
 void GameData::dump() const {
     std::cout << "\n## Strings\n";
-    for (const auto &def : strings) {
+    for (const auto &def : allItems(strings, image->strings)) {
         std::cout << '[' << def.first << ((def.second && def.second->isStatic) ? 's' : ' ') << "] ~";
         if (def.second)     dump_string(def.second->text);
         else                std::cout << "(nullptr)";
@@ -26,7 +38,7 @@ void GameData::dump() const {
     }
 
     std::cout << "\n## Lists\n";
-    for (const auto &def : lists) {
+    for (const auto &def : allItems(lists, image->lists)) {
         std::cout << '[' << def.first << ((def.second && def.second->isStatic) ? 's' : ' ') << "] {";
         if (!def.second) {
             std::cout << "(nullptr)";
@@ -39,7 +51,7 @@ void GameData::dump() const {
     }
 
     std::cout << "\n## Maps\n";
-    for (const auto &def : maps) {
+    for (const auto &def : allItems(maps, image->maps)) {
         std::cout << '[' << def.first << ((def.second && def.second->isStatic) ? 's' : ' ') << "] {";
         if (!def.second) {
             std::cout << "(nullptr)";
@@ -52,7 +64,7 @@ void GameData::dump() const {
     }
 
     std::cout << "\n## Objects\n";
-    for (const auto &def : objects) {
+    for (const auto &def : allItems(objects, image->objects)) {
         std::cout << '[' << def.first << ((def.second && def.second->isStatic) ? 's' : ' ') << "] {";
         if (!def.second) {
             std::cout << "(nullptr)";
@@ -65,10 +77,11 @@ void GameData::dump() const {
     }
 
     std::cout << "\n## Function Headers\n";
-    for (const auto &def : functions) {
-        std::cout << '[' << def.first << "] args: ";
-        std::cout << def.second.arg_count << " locals: ";
-        std::cout << def.second.local_count << " position: ";
-        std::cout << def.second.position << "\n";
+    for (const FunctionDef &def : image->functions) {
+        if (def.ident == static_cast<unsigned>(-1)) continue;
+        std::cout << '[' << def.ident << "] args: ";
+        std::cout << def.arg_count << " locals: ";
+        std::cout << def.local_count << " position: ";
+        std::cout << def.position << "\n";
     }
 }
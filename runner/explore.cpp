@@ -0,0 +1,143 @@
+#include <condition_variable>
+#include <deque>
+#include <iostream>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include "gamedata.h"
+
+struct ExploreBranch {
+    GameData gamedata;
+    bool hasValue;
+    Value nextValue;
+    int depth;
+    std::string path;
+};
+
+class Explorer {
+public:
+    Explorer(int maxDepth)
+    : maxDepth(maxDepth), busyWorkers(0), choicePoints(0), endings(0),
+      inputStops(0), depthStops(0), errors(0)
+    { }
+
+    void run(GameData &start, int threadCount);
+
+private:
+    void worker();
+    void explore(ExploreBranch &branch);
+
+    int maxDepth;
+    std::mutex mutex;
+    std::condition_variable wakeup;
+    std::deque<ExploreBranch> branches;
+    int busyWorkers;
+
+    int choicePoints, endings, inputStops, depthStops, errors;
+};
+
+void Explorer::run(GameData &start, int threadCount) {
+    branches.push_back(ExploreBranch{start.fork(), false, Value(), 0, ""});
+
+    std::vector<std::thread> threads;
+    for (int i = 0; i < threadCount; ++i) {
+        threads.push_back(std::thread(&Explorer::worker, this));
+    }
+    for (std::thread &thread : threads) {
+        thread.join();
+    }
+
+    std::cout << "Explored " << choicePoints << " choice points to depth ";
+    std::cout << maxDepth << " using " << threadCount << " threads.\n";
+    std::cout << "    endings reached:          " << endings << '\n';
+    std::cout << "    stopped at text input:    " << inputStops << '\n';
+    std::cout << "    stopped at depth limit:   " << depthStops << '\n';
+    std::cout << "    runtime errors:           " << errors << '\n';
+}
+
+void Explorer::worker() {
+    while (1) {
+        std::unique_lock<std::mutex> lock(mutex);
+        wakeup.wait(lock, [this]{ return !branches.empty() || busyWorkers == 0; });
+        if (branches.empty()) {
+            // nothing queued and nothing running that could queue more
+            wakeup.notify_all();
+            return;
+        }
+        // take the newest branch so the search stays depth first and the
+        // number of live games stays small
+        ExploreBranch branch = std::move(branches.back());
+        branches.pop_back();
+        ++busyWorkers;
+        lock.unlock();
+
+        explore(branch);
+
+        lock.lock();
+        --busyWorkers;
+        wakeup.notify_all();
+    }
+}
+
+void Explorer::explore(ExploreBranch &branch) {
+    GameData &gamedata = branch.gamedata;
+    if (branch.depth > 0 && branch.depth % GARBAGE_FREQUENCY == 0) {
+        gamedata.collectGarbage();
+    }
+    gamedata.startTurn();
+    try {
+        gamedata.resume(branch.hasValue, branch.nextValue);
+    } catch (GameError &e) {
+        std::lock_guard<std::mutex> lock(mutex);
+        ++errors;
+        std::cerr << "RUNTIME ERROR after choices [" << branch.path << " ]: ";
+        std::cerr << e.what() << '\n';
+        return;
+    }
+
+    switch(gamedata.optionType) {
+        case OptionType::Choice: {
+            // fork every option before taking the lock; queue them in
+            // reverse so the first option is the next one explored
+            std::vector<ExploreBranch> next;
+            if (branch.depth < maxDepth) {
+                for (int i = gamedata.options.size() - 1; i >= 0; --i) {
+                    const GameOption &option = gamedata.options[i];
+                    next.push_back(ExploreBranch{gamedata.fork(), true, option.value,
+                                                 branch.depth + 1,
+                                                 branch.path + " " + std::to_string(i + 1)});
+                    next.back().gamedata.setExtra(option.extra);
+                }
+            }
+            std::lock_guard<std::mutex> lock(mutex);
+            ++choicePoints;
+            if (branch.depth >= maxDepth) ++depthStops;
+            for (ExploreBranch &newBranch : next) {
+                branches.push_back(std::move(newBranch));
+            }
+            break; }
+        case OptionType::Key:
+        case OptionType::Line: {
+            std::lock_guard<std::mutex> lock(mutex);
+            ++inputStops;
+            break; }
+        case OptionType::EndOfProgram: {
+            std::lock_guard<std::mutex> lock(mutex);
+            ++endings;
+            break; }
+        default: {
+            std::lock_guard<std::mutex> lock(mutex);
+            ++errors;
+            std::cerr << "Unknown option type " << static_cast<int>(gamedata.optionType);
+            std::cerr << " after choices [" << branch.path << " ]\n";
+            break; }
+    }
+}
+
+void explore(GameData &gamedata, int maxDepth, int threadCount) {
+    GameData start = gamedata.fork();
+    startGame(start);
+    Explorer explorer(maxDepth);
+    explorer.run(start, threadCount);
+}
@@ -15,6 +15,8 @@
 
 #include "textutil.h"
 #include "gamedata.h"
+#include "probe.h"
+#include "trace.h"
 
 
 static std::string getRealPath(const std::string &filename) {
@@ -88,6 +90,7 @@ static void writeString(std::ostream &inf, const std::string &text) {
 
 
 FileList GameData::getFileList() {
+    PROBE_SCOPE("read file list", 0);
     FileList list;
     std::ifstream listfile(getRealPath("ratvm.lst"));
     if (!listfile) return list;
@@ -114,6 +117,7 @@ FileList GameData::getFileList() {
 }
 
 bool GameData::saveFileList(const FileList &files) {
+    PROBE_SCOPE("write file list", 0);
     std::ofstream out(getRealPath("ratvm.lst"));
     if (!out) return false;
 
@@ -127,7 +131,28 @@ bool GameData::saveFileList(const FileList &files) {
     return true;
 }
 
+// The file functions used by the game go through the trace, if there is
+// one. When replaying a trace they never touch the real files at all.
 Value GameData::getFile(const std::string &fileName) {
+    std::vector<int> values;
+    bool found = false;
+    if (!trace || !trace->isReplaying()) found = readFile(fileName, values);
+    if (trace) found = trace->fileData(found, values);
+    if (!found) return noneValue;
+
+    Value newListId = makeNew(Value::List);
+    if (newListId.type != Value::List) {
+        throw GameError("Failed to create list for new file.");
+    }
+    ListDef &newList = getMutableList(newListId.value);
+    for (int v : values) {
+        newList.items.push_back(Value(Value::Integer, v));
+    }
+    return newListId;
+}
+
+bool GameData::readFile(const std::string &fileName, std::vector<int> &values) {
+    PROBE_SCOPE("read file", 0);
     FileList files = getFileList();
 
     FileRecord file;
@@ -141,24 +166,19 @@ Value GameData::getFile(const std::string &fileName) {
     }
 
     if (file.fileId < 0) {
-        return noneValue;
+        return false;
     }
 
-    Value newListId = makeNew(Value::List);
-    if (newListId.type != Value::List) {
-        throw GameError("Failed to create list for new file.");
-    }
-    ListDef &newList = getList(newListId.value);
     std::stringstream realFilename;
     realFilename << "rat" << std::setfill('0') << std::setw(5) << file.fileId << ".fil";
     std::ifstream inf(getRealPath(realFilename.str()));
     while (1) {
         int v = read32(inf);
         if (inf.eof()) break;
-        newList.items.push_back(Value(Value::Integer, v));
+        values.push_back(v);
     }
 
-    return newListId;
+    return true;
 }
 
 int nextFile(const FileList &fileList) {
@@ -171,6 +191,19 @@ int nextFile(const FileList &fileList) {
 
 
 bool GameData::saveFile(const std::string &filename, const ListDef *list) {
+    for (const Value &v : list->items) {
+        if (v.type != Value::Integer) {
+            throw GameError("List of data to save must contain only integers.");
+        }
+    }
+    bool result = true;
+    if (!trace || !trace->isReplaying()) result = writeFile(filename, list);
+    if (trace) result = trace->fileResult(result);
+    return result;
+}
+
+bool GameData::writeFile(const std::string &filename, const ListDef *list) {
+    PROBE_SCOPE("write file", 0);
     FileList files = getFileList();
 
     FileRecord file;
@@ -198,9 +231,6 @@ bool GameData::saveFile(const std::string &filename, const ListDef *list) {
     realFilename << "rat" << std::setfill('0') << std::setw(5) << file.fileId << ".fil";
     std::ofstream out(getRealPath(realFilename.str()));
     for (const Value &v : list->items) {
-        if (v.type != Value::Integer) {
-            throw GameError("List of data to save must contain only integers; file data corrupted.");
-        }
         write32(out, v.value);
     }
 
@@ -208,6 +238,14 @@ bool GameData::saveFile(const std::string &filename, const ListDef *list) {
 }
 
 bool GameData::deleteFile(const std::string &filename) {
+    bool result = false;
+    if (!trace || !trace->isReplaying()) result = removeFile(filename);
+    if (trace) result = trace->fileResult(result);
+    return result;
+}
+
+bool GameData::removeFile(const std::string &filename) {
+    PROBE_SCOPE("delete file", 0);
     FileList files = getFileList();
 
     FileRecord file;
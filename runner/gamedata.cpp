@@ -1,8 +1,15 @@
 #include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <fstream>
+#include <iomanip>
 #include <iostream>
 #include <sstream>
 #include <string>
+#include <tuple>
 #include "gamedata.h"
+#include "probe.h"
+#include "profile.h"
 #include "textutil.h"
 
 Value ListDef::get(int key) const {
@@ -70,7 +77,7 @@ void MapDef::del(const Value &key) {
 }
 
 
-Value ObjectDef::get(GameData &gamedata, unsigned propId, bool checkPrototype) const {
+Value ObjectDef::get(const GameData &gamedata, unsigned propId, bool checkPrototype) const {
     auto iter = properties.find(propId);
     if (iter == properties.end()) {
         if (checkPrototype) {
@@ -97,121 +104,168 @@ void ObjectDef::set(unsigned propId, const Value &value) {
 }
 
 
-GameData::~GameData() {
-    for (const auto &def : objects)  if (def.second) delete def.second;
-    for (const auto &def : lists)    if (def.second) delete def.second;
-    for (const auto &def : maps)     if (def.second) delete def.second;
-    for (const auto &def : strings)  if (def.second) delete def.second;
+// Forking copies only this game's own items; the items themselves and the
+// story image stay shared. Both games move to a new generation afterwards,
+// so neither one owns the shared items and each will copy an item before
+// changing it.
+GameData GameData::fork() {
+    GameData newGame(*this);
+    newGame.opcodeProfile = nullptr;
+    newGame.functionProfile = nullptr;
+    newGame.sampleProfile = nullptr;
+    newGame.trace = nullptr;
+    newGame.mGeneration = newGeneration();
+    mGeneration = newGeneration();
+    return newGame;
 }
 
-const StringDef& GameData::getString(int index) const {
-    const auto &def = strings.find(index);
-    if (def == strings.end()) {
-        throw GameBadReference("Tried to access invalid string number "
-                        + std::to_string(index));
-    }
-    return *def->second;
+unsigned GameData::newGeneration() {
+    static std::atomic<unsigned> nextGeneration(1);
+    return nextGeneration++;
 }
-StringDef& GameData::getString(int index) {
-    auto def = strings.find(index);
-    if (def == strings.end()) {
-        throw GameBadReference("Tried to access invalid string number "
-                        + std::to_string(index));
+
+// Find a heap item in the game's own items, falling back to the static items
+// in the story image. Returns nullptr if no such item exists.
+template<class T>
+static const T* findItem(const std::map<int, std::shared_ptr<T>> &items,
+                         const std::vector<std::shared_ptr<const T>> &statics,
+                         int index) {
+    auto iter = items.find(index);
+    if (iter != items.end()) return iter->second.get();
+    if (index >= 0 && index < static_cast<int>(statics.size())) {
+        return statics[index].get();
     }
-    return *def->second;
+    return nullptr;
 }
-const ListDef& GameData::getList(int index) const {
-    const auto &def = lists.find(index);
-    if (def == lists.end()) {
-        throw GameBadReference("Tried to access invalid list number "
-                        + std::to_string(index));
+
+template<class T>
+static const T& getItem(const std::map<int, std::shared_ptr<T>> &items,
+                        const std::vector<std::shared_ptr<const T>> &statics,
+                        int index, const char *typeName) {
+    const T *item = findItem(items, statics, index);
+    if (!item) {
+        throw GameBadReference(std::string("Tried to access invalid ") + typeName
+                               + " number " + std::to_string(index));
     }
-    return *def->second;
+    return *item;
 }
-ListDef& GameData::getList(int index) {
-    auto def = lists.find(index);
-    if (def == lists.end()) {
-        throw GameBadReference("Tried to access invalid list number "
-                        + std::to_string(index));
+
+// Get a heap item that's about to be changed. Items still in the story image
+// or owned by a different fork generation are copied first.
+template<class T>
+T& GameData::getMutableItem(std::map<int, std::shared_ptr<T>> &items,
+                            const std::vector<std::shared_ptr<const T>> &statics,
+                            int index, const char *typeName) {
+    auto iter = items.find(index);
+    if (iter == items.end()) {
+        const T &original = getItem(items, statics, index, typeName);
+        iter = items.insert(std::make_pair(index, std::make_shared<T>(original))).first;
+        iter->second->owner = mGeneration;
+    } else if (iter->second->owner != mGeneration) {
+        iter->second = std::make_shared<T>(*iter->second);
+        iter->second->owner = mGeneration;
     }
-    return *def->second;
+    return *iter->second;
+}
+
+const StringDef& GameData::getString(int index) const {
+    return getItem(strings, image->strings, index, "string");
+}
+StringDef& GameData::getMutableString(int index) {
+    return getMutableItem(strings, image->strings, index, "string");
+}
+const ListDef& GameData::getList(int index) const {
+    return getItem(lists, image->lists, index, "list");
+}
+ListDef& GameData::getMutableList(int index) {
+    return getMutableItem(lists, image->lists, index, "list");
 }
 const MapDef& GameData::getMap(int index) const {
-    const auto &def = maps.find(index);
-    if (def == maps.end()) {
-        throw GameBadReference("Tried to access invalid map number "
-                        + std::to_string(index));
-    }
-    return *def->second;
+    return getItem(maps, image->maps, index, "map");
 }
-MapDef& GameData::getMap(int index) {
-    auto def = maps.find(index);
-    if (def == maps.end()) {
-        throw GameBadReference("Tried to access invalid map number "
-                        + std::to_string(index));
-    }
-    return *def->second;
+MapDef& GameData::getMutableMap(int index) {
+    return getMutableItem(maps, image->maps, index, "map");
 }
 const ObjectDef& GameData::getObject(int index) const {
-    const auto &def = objects.find(index);
-    if (def == objects.end()) {
-        throw GameBadReference("Tried to access invalid object number "
-                        + std::to_string(index));
-    }
-    return *def->second;
+    return getItem(objects, image->objects, index, "object");
 }
-ObjectDef& GameData::getObject(int index) {
-    auto def = objects.find(index);
-    if (def == objects.end()) {
-        throw GameBadReference("Tried to access invalid object number "
-                        + std::to_string(index));
-    }
-    return *def->second;
+ObjectDef& GameData::getMutableObject(int index) {
+    return getMutableItem(objects, image->objects, index, "object");
 }
 const FunctionDef& GameData::getFunction(int index) const {
-    const auto &def = functions.find(index);
-    if (def == functions.end()) {
+    if (index < 0 || index >= static_cast<int>(image->functions.size())
+            || image->functions[index].ident != static_cast<unsigned>(index)) {
         throw GameBadReference("Tried to access invalid function number "
                         + std::to_string(index));
     }
-    return def->second;
-}
-FunctionDef& GameData::getFunction(int index) {
-    auto def = functions.find(index);
-    if (def == functions.end()) {
-        throw GameBadReference("Tried to access invalid funtion number "
-                        + std::to_string(index));
-    }
-    return def->second;
+    return image->functions[index];
 }
 
-std::string NO_SUCH_VOCAB("INVALID VOCAB");
-const std::string& GameData::getVocab(int index) const {
-    if (index < 0 || index >= static_cast<int>(vocab.size())) {
-        NO_SUCH_VOCAB = "INVALID VOCAB " + std::to_string(index);
-        return NO_SUCH_VOCAB;
+std::string GameData::getVocab(int index) const {
+    if (index < 0 || index >= static_cast<int>(image->vocab.size())) {
+        return "INVALID VOCAB " + std::to_string(index);
     }
-    return vocab[index];
+    return image->vocab[index];
 }
 int GameData::getVocab(const std::string &text) const {
-    for (unsigned i = 0; i < vocab.size(); ++i) {
-        if (vocab[i] == text) return i;
+    for (unsigned i = 0; i < image->vocab.size(); ++i) {
+        if (image->vocab[i] == text) return i;
     }
     return -1;
 }
 
-int GameData::collectGarbage() {
-    // clear existing marks
-    for (auto &def : objects) if (def.second)  def.second->gcMark = false;
-    for (auto &def : lists)   if (def.second)  def.second->gcMark = false;
-    for (auto &def : maps)    if (def.second)  def.second->gcMark = false;
-    for (auto &def : strings) if (def.second)  def.second->gcMark = false;
-
-    // mark objects
-    for (auto &def : objects)   if (def.second && def.second->isStatic) mark(*def.second);
-    for (auto &def : lists)     if (def.second && def.second->isStatic) mark(*def.second);
-    for (auto &def : maps)      if (def.second && def.second->isStatic) mark(*def.second);
-    for (auto &def : strings)   if (def.second && def.second->isStatic) mark(*def.second);
+// The approximate number of bytes used by the contents of a heap item.
+static unsigned long long contentSize(const StringDef &item) {
+    return item.text.size();
+}
+static unsigned long long contentSize(const ListDef &item) {
+    return item.items.size() * sizeof(Value);
+}
+static unsigned long long contentSize(const MapDef &item) {
+    return item.rows.size() * sizeof(MapDef::Row);
+}
+static unsigned long long contentSize(const ObjectDef &item) {
+    return item.properties.size() * (sizeof(unsigned) + sizeof(Value));
+}
+
+// Remove every unmarked item from a heap table, returning the number removed
+// and recording the number and size of the items that remain.
+template<class T>
+static int sweep(std::map<int, std::shared_ptr<T>> &items, const std::vector<bool> &marked,
+                 HeapStats &stats, int heapType) {
+    int collectionCount = 0;
+    unsigned long long bytes = 0;
+    for (auto iter = items.begin(); iter != items.end(); ) {
+        if (!iter->second || !marked[iter->first]) {
+            iter = items.erase(iter);
+            ++collectionCount;
+        } else {
+            bytes += contentSize(*iter->second);
+            ++iter;
+        }
+    }
+    stats.live[heapType] = items.size();
+    stats.bytes[heapType] = bytes;
+    stats.lastFreed[heapType] = collectionCount;
+    stats.freed[heapType] += collectionCount;
+    return collectionCount;
+}
+
+// Mark every item the game can still reach.
+void GameData::markReachable() {
+    // clear existing marks; these are kept here rather than on the items
+    // since items may be shared with forked games
+    mMarkedObjects.assign(nextObject, false);
+    mMarkedLists.assign(nextList, false);
+    mMarkedMaps.assign(nextMap, false);
+    mMarkedStrings.assign(nextString, false);
+
+    // mark objects; static items are always in use, whether or not this game
+    // has its own copy of them
+    for (unsigned i = 0; i < image->objects.size(); ++i) if (image->objects[i]) mark(getObject(i));
+    for (unsigned i = 0; i < image->lists.size(); ++i)   if (image->lists[i])   mark(getList(i));
+    for (unsigned i = 0; i < image->maps.size(); ++i)    if (image->maps[i])    mark(getMap(i));
+    for (unsigned i = 0; i < image->strings.size(); ++i) if (image->strings[i]) mark(getString(i));
     // mark options
     for (GameOption &option : options) {
         mark(option.extra);
@@ -227,88 +281,222 @@ int GameData::collectGarbage() {
             mark(value);
         }
     }
+}
+
+int GameData::collectGarbage() {
+    PROBE_SCOPE("collect garbage", 0);
+    typedef std::chrono::steady_clock Clock;
+    Clock::time_point markStart = Clock::now();
+    PROBE_BEGIN("mark", 0);
+    markReachable();
 
     // collect objects
+    PROBE_END("mark");
+    Clock::time_point sweepStart = Clock::now();
+    PROBE_BEGIN("sweep", 0);
     int collectionCount = 0;
-    for (auto iter = objects.begin(); iter != objects.end(); ) {
-        if (!iter->second || !iter->second->gcMark) {
-            if (iter->second) delete iter->second;
-            iter = objects.erase(iter);
-            ++collectionCount;
-        } else {
-            ++iter;
-        }
-    }
+    collectionCount += sweep(objects, mMarkedObjects, heapStats, HEAP_OBJECTS);
+    collectionCount += sweep(lists, mMarkedLists, heapStats, HEAP_LISTS);
+    collectionCount += sweep(maps, mMarkedMaps, heapStats, HEAP_MAPS);
+    collectionCount += sweep(strings, mMarkedStrings, heapStats, HEAP_STRINGS);
+    PROBE_END("sweep");
+    Clock::time_point sweepEnd = Clock::now();
+
+    ++heapStats.collections;
+    heapStats.lastMarkTime = std::chrono::duration_cast<std::chrono::microseconds>(
+                                sweepStart - markStart).count();
+    heapStats.lastSweepTime = std::chrono::duration_cast<std::chrono::microseconds>(
+                                sweepEnd - sweepStart).count();
+    heapStats.markTime += heapStats.lastMarkTime;
+    heapStats.sweepTime += heapStats.lastSweepTime;
+    unsigned long long liveCount = 0;
+    for (unsigned long long count : heapStats.live) liveCount += count;
+    if (liveCount > heapStats.highWater) heapStats.highWater = liveCount;
+    return collectionCount;
+}
 
-    for (auto iter = lists.begin(); iter != lists.end(); ) {
-        if (!iter->second || !iter->second->gcMark) {
-            if (iter->second) delete iter->second;
-            iter = lists.erase(iter);
-            ++collectionCount;
-        } else {
-            ++iter;
+// Clear the output and counters from the last turn before running the game
+// for another one.
+void GameData::startTurn() {
+    textBuffer = "";
+    options.clear();
+    instructionCount = 0;
+    heapStats.turnCreated = 0;
+    ++heapStats.turns;
+}
+
+unsigned long long HeapStats::get(int statistic) const {
+    switch(statistic) {
+        case HEAPSTAT_COLLECTIONS:  return collections;
+        case HEAPSTAT_MARK_TIME:    return lastMarkTime;
+        case HEAPSTAT_SWEEP_TIME:   return lastSweepTime;
+        case HEAPSTAT_GC_TIME:      return markTime + sweepTime;
+        case HEAPSTAT_HIGH_WATER:   return highWater;
+        case HEAPSTAT_TURN_CREATED: return turnCreated;
+        case HEAPSTAT_TURNS:        return turns;
+    }
+    if (statistic >= HEAPSTAT_LIVE && statistic < HEAPSTAT_COUNT) {
+        int heapType = (statistic - HEAPSTAT_LIVE) % HEAP_TYPES;
+        switch(statistic - heapType) {
+            case HEAPSTAT_LIVE:         return live[heapType];
+            case HEAPSTAT_BYTES:        return bytes[heapType];
+            case HEAPSTAT_LAST_FREED:   return lastFreed[heapType];
+            case HEAPSTAT_FREED:        return freed[heapType];
+            case HEAPSTAT_CREATED:      return created[heapType];
         }
     }
-    for (auto iter = maps.begin(); iter != maps.end(); ) {
-        if (!iter->second || !iter->second->gcMark) {
-            if (iter->second) delete iter->second;
-            iter = maps.erase(iter);
-            ++collectionCount;
-        } else {
-            ++iter;
+    std::stringstream ss;
+    ss << "Unknown heap statistic " << statistic << '.';
+    throw GameError(ss.str());
+}
+
+static const char *heapTypeNames[HEAP_TYPES] = { "strings", "lists", "maps", "objects" };
+
+void HeapStats::write(std::ostream &out) const {
+    out << "HEAP STATISTICS: " << collections << " collections over " << turns << " turns\n\n";
+    out << std::left << std::setw(10) << "" << std::right;
+    out << std::setw(12) << "live" << std::setw(14) << "bytes";
+    out << std::setw(12) << "last freed" << std::setw(14) << "total freed";
+    out << std::setw(14) << "created" << '\n';
+    for (int i = 0; i < HEAP_TYPES; ++i) {
+        out << std::left << std::setw(10) << heapTypeNames[i] << std::right;
+        out << std::setw(12) << live[i] << std::setw(14) << bytes[i];
+        out << std::setw(12) << lastFreed[i] << std::setw(14) << freed[i];
+        out << std::setw(14) << created[i] << '\n';
+    }
+    out << std::fixed << std::setprecision(3);
+    out << "\nmark time:          " << markTime / 1000.0 << " ms";
+    out << " (last " << lastMarkTime / 1000.0 << " ms)\n";
+    out << "sweep time:         " << sweepTime / 1000.0 << " ms";
+    out << " (last " << lastSweepTime / 1000.0 << " ms)\n";
+    out << std::defaultfloat;
+    out << "most live items:    " << highWater << '\n';
+    unsigned long long createdCount = 0;
+    for (unsigned long long count : created) createdCount += count;
+    out << "items created:      " << createdCount << " (";
+    if (turns > 0) out << createdCount / turns << " per turn, ";
+    out << "at most " << maxTurnCreated << " in one turn)\n";
+}
+
+// The reachable items of one type created at one place.
+struct AllocationSite {
+    AllocationSite() : count(0), bytes(0) { }
+    unsigned long long count, bytes;
+};
+// heap type, function, and instruction; the function is -1 for dynamic items
+// created while allocations weren't tracked
+typedef std::tuple<int, int, unsigned> SiteKey;
+static const int SITE_STATIC = -2;  // the game's copies of changed static items
+
+template<class T>
+static void tallySites(const std::map<int, std::shared_ptr<T>> &items,
+                       const std::vector<bool> &marked, int heapType,
+                       std::map<SiteKey, AllocationSite> &sites) {
+    for (const auto &item : items) {
+        if (!item.second || !marked[item.first]) continue;
+        SiteKey key(heapType, SITE_STATIC, 0);
+        if (item.second->srcName == ORIGIN_DYNAMIC) {
+            std::get<1>(key) = item.second->allocFunction;
+            if (item.second->allocFunction >= 0) std::get<2>(key) = item.second->allocIP;
         }
-    }
-    for (auto iter = strings.begin(); iter != strings.end(); ) {
-        if (!iter->second || !iter->second->gcMark) {
-            if (iter->second) delete iter->second;
-            iter = strings.erase(iter);
-            ++collectionCount;
+        AllocationSite &site = sites[key];
+        ++site.count;
+        site.bytes += contentSize(*item.second);
+    }
+}
+
+// Items that stay reachable turn after turn are held by something the game
+// never lets go of, so finding which code keeps creating them is the first
+// step to tracking down a leak. Nothing is collected; unreachable items are
+// simply left out.
+void GameData::writeHeapReport(std::ostream &out) {
+    markReachable();
+    std::map<SiteKey, AllocationSite> sites;
+    tallySites(strings, mMarkedStrings, HEAP_STRINGS, sites);
+    tallySites(lists, mMarkedLists, HEAP_LISTS, sites);
+    tallySites(maps, mMarkedMaps, HEAP_MAPS, sites);
+    tallySites(objects, mMarkedObjects, HEAP_OBJECTS, sites);
+
+    std::vector<std::pair<SiteKey, AllocationSite>> sorted(sites.begin(), sites.end());
+    std::sort(sorted.begin(), sorted.end(),
+        [](const std::pair<SiteKey, AllocationSite> &a, const std::pair<SiteKey, AllocationSite> &b) {
+            if (a.second.bytes != b.second.bytes) return a.second.bytes > b.second.bytes;
+            return a.second.count > b.second.count;
+        });
+    unsigned long long totalCount = 0, totalBytes = 0;
+    for (const auto &site : sorted) {
+        totalCount += site.second.count;
+        totalBytes += site.second.bytes;
+    }
+
+    out << "HEAP REPORT: " << totalCount << " reachable items using ";
+    out << totalBytes << " bytes, by where they were created\n\n";
+    out << std::setw(12) << "items" << std::setw(14) << "bytes" << "  ";
+    out << std::left << std::setw(10) << "type" << "created at\n" << std::right;
+    for (const auto &site : sorted) {
+        int functionId = std::get<1>(site.first);
+        out << std::setw(12) << site.second.count << std::setw(14) << site.second.bytes << "  ";
+        out << std::left << std::setw(10) << heapTypeNames[std::get<0>(site.first)] << std::right;
+        if (functionId == SITE_STATIC) {
+            out << "(changed static items)";
+        } else if (functionId < 0) {
+            out << "(not tracked)";
         } else {
-            ++iter;
+            out << functionName(*this, functionId) << '+';
+            out << std::get<2>(site.first) - getFunction(functionId).position;
         }
+        out << '\n';
     }
+}
 
-    return collectionCount;
+bool GameData::writeHeapReport(const std::string &filename) {
+    std::ofstream out(filename);
+    if (!out) return false;
+    writeHeapReport(out);
+    return static_cast<bool>(out);
 }
 
-void GameData::mark(ObjectDef &object) {
-    object.gcMark = true;
+void GameData::mark(const ObjectDef &object) {
+    if (mMarkedObjects[object.ident]) return;
+    mMarkedObjects[object.ident] = true;
     for (const auto &prop : object.properties) {
         mark(prop.second);
     }
 }
 
-void GameData::mark(ListDef &list) {
-    list.gcMark = true;
+void GameData::mark(const ListDef &list) {
+    if (mMarkedLists[list.ident]) return;
+    mMarkedLists[list.ident] = true;
     for (const Value &value : list.items) mark(value);
 }
 
-void GameData::mark(MapDef &map) {
-    map.gcMark = true;
+void GameData::mark(const MapDef &map) {
+    if (mMarkedMaps[map.ident]) return;
+    mMarkedMaps[map.ident] = true;
     for (const auto &row : map.rows) {
         mark(row.key);
         mark(row.value);
     }
 }
 
-void GameData::mark(StringDef &str) {
-    str.gcMark = true;
+void GameData::mark(const StringDef &str) {
+    mMarkedStrings[str.ident] = true;
 }
 
 void GameData::mark(const Value &value) {
     try {
         switch(value.type) {
             case Value::Object:
-                mark(getList(value.value));
+                mark(getObject(value.value));
                 break;
             case Value::List:
                 mark(getList(value.value));
                 break;
             case Value::Map:
-                mark(getList(value.value));
+                mark(getMap(value.value));
                 break;
             case Value::String:
-                mark(getList(value.value));
+                mark(getString(value.value));
                 break;
 
             // remaining types not handled by garbage collector so just skip them
@@ -385,38 +573,53 @@ void GameData::say(const Value &what) {
     say(asString(what));
 }
 
+void GameData::setDynamicOrigin(DataItem &item) {
+    item.srcFile = item.srcLine = item.srcName = ORIGIN_DYNAMIC;
+    item.owner = mGeneration;
+    if (trackAllocations && !callStack.isEmpty()) {
+        item.allocFunction = callStack.callTop().functionId;
+        item.allocIP = allocationIP;
+    }
+}
+
 Value GameData::makeNew(Value::Type type) {
+    if (functionProfile) functionProfile->allocation();
+    PROBE_EVENT("new", type);
     switch(type) {
         case Value::List: {
-            ListDef *newDef = new ListDef;
+            std::shared_ptr<ListDef> newDef = std::make_shared<ListDef>();
             newDef->ident = nextList;
             ++nextList;
-            newDef->srcFile = newDef->srcLine = newDef->srcName = ORIGIN_DYNAMIC;
+            setDynamicOrigin(*newDef);
             lists.insert(std::make_pair(newDef->ident, newDef));
+            heapStats.itemCreated(HEAP_LISTS);
             return Value(Value::List, newDef->ident);
         }
         case Value::Map: {
-            MapDef *newDef = new MapDef;
+            std::shared_ptr<MapDef> newDef = std::make_shared<MapDef>();
             newDef->ident = nextMap;
             ++nextMap;
-            newDef->srcFile = newDef->srcLine = newDef->srcName = ORIGIN_DYNAMIC;
+            setDynamicOrigin(*newDef);
             maps.insert(std::make_pair(newDef->ident, newDef));
+            heapStats.itemCreated(HEAP_MAPS);
             return Value(Value::Map, newDef->ident);
         }
         case Value::Object: {
-            ObjectDef *newDef = new ObjectDef;
+            std::shared_ptr<ObjectDef> newDef = std::make_shared<ObjectDef>();
             newDef->ident = nextObject;
             ++nextObject;
-            newDef->srcFile = newDef->srcLine = newDef->srcName = ORIGIN_DYNAMIC;
+            setDynamicOrigin(*newDef);
             objects.insert(std::make_pair(newDef->ident, newDef));
+            heapStats.itemCreated(HEAP_OBJECTS);
             return Value(Value::Object, newDef->ident);
         }
         case Value::String: {
-            StringDef *newDef = new StringDef;
+            std::shared_ptr<StringDef> newDef = std::make_shared<StringDef>();
             newDef->ident = nextString;
             ++nextString;
-            newDef->srcFile = newDef->srcLine = newDef->srcName = ORIGIN_DYNAMIC;
+            setDynamicOrigin(*newDef);
             strings.insert(std::make_pair(newDef->ident, newDef));
+            heapStats.itemCreated(HEAP_STRINGS);
             return Value(Value::String, newDef->ident);
         }
         default:
@@ -429,7 +632,7 @@ Value GameData::makeNew(Value::Type type) {
 
 Value GameData::makeNewString(const std::string &str) {
     Value newId = makeNew(Value::String);
-    StringDef &def = getString(newId.value);
+    StringDef &def = getMutableString(newId.value);
     def.text = str;
     return newId;
 }
@@ -439,19 +642,19 @@ void GameData::moveObject(Value objectToMove, Value newParent) {
         throw GameError("Tried to create circular containment.");
     }
 
-    ObjectDef &toMove = getObject(objectToMove.value);
+    ObjectDef &toMove = getMutableObject(objectToMove.value);
     unsigned oldParent = toMove.parentId;
     toMove.parentId = 0;
     if (oldParent > 0) {
-        ObjectDef &oldParentObj = getObject(oldParent);
+        ObjectDef &oldParentObj = getMutableObject(oldParent);
         if (oldParentObj.childId == toMove.ident) {
             oldParentObj.childId = toMove.siblingId;
         } else {
             unsigned child = oldParentObj.childId;
             while (child > 0) {
-                ObjectDef &c = getObject(child);
+                const ObjectDef &c = getObject(child);
                 if (c.siblingId == toMove.ident) {
-                    c.siblingId = toMove.siblingId;
+                    getMutableObject(child).siblingId = toMove.siblingId;
                     break;
                 }
                 child = c.siblingId;
@@ -462,17 +665,17 @@ void GameData::moveObject(Value objectToMove, Value newParent) {
 
     if (newParent.type != Value::None) {
         toMove.parentId = newParent.value;
-        ObjectDef &parent = getObject(newParent.value);
+        ObjectDef &parent = getMutableObject(newParent.value);
         if (parent.childId == 0) {
             parent.childId = objectToMove.value;
         } else {
             int childId = parent.childId;
             while (1) {
-                ObjectDef &child = getObject(childId);
+                const ObjectDef &child = getObject(childId);
                 if (child.siblingId > 0) {
                     childId = child.siblingId;
                 } else {
-                    child.siblingId = objectToMove.value;
+                    getMutableObject(childId).siblingId = objectToMove.value;
                     break;
                 }
             }
@@ -484,16 +687,16 @@ bool GameData::isIndirectLoop(unsigned childId, unsigned parentId) {
     if (childId == 0 || parentId == 0) return false;
     if (childId == parentId) return true;
 
-    ObjectDef &object = getObject(childId);
+    const ObjectDef &object = getObject(childId);
     if (object.parentId == parentId) return true;
-    ObjectDef &parent = getObject(parentId);
+    const ObjectDef &parent = getObject(parentId);
 
     unsigned superParentId = parent.parentId;
     while (superParentId > 0) {
         if (superParentId == object.ident) {
             return true;
         } else {
-            ObjectDef &superParent = getObject(superParentId);
+            const ObjectDef &superParent = getObject(superParentId);
             superParentId = superParent.parentId;
         }
     }
@@ -530,7 +733,7 @@ bool GameData::isValid(const Value &what) const {
             case Value::Map:        getMap(what.value);         break;
             case Value::String:     getString(what.value);      break;
             case Value::Function:   getFunction(what.value);    break;
-            case Value::Vocab:      return what.value > 0 && what.value < static_cast<int>(vocab.size());
+            case Value::Vocab:      return what.value > 0 && what.value < static_cast<int>(image->vocab.size());
             default:                return true;
         }
     } catch (const GameBadReference&) {
@@ -542,7 +745,7 @@ bool GameData::isValid(const Value &what) const {
 void GameData::stringAppend(const Value &stringId, const Value &toAppend, bool wantUpperFirst) {
     stringId.requireType(Value::String);
     std::string newText = asString(toAppend);
-    StringDef &strDef = getString(stringId.value);
+    StringDef &strDef = getMutableString(stringId.value);
     if (wantUpperFirst) upperFirst(newText);
     strDef.text += newText;
     normalize(strDef.text);
@@ -586,7 +789,7 @@ private:
     const GameData &data;
 };
 void GameData::sortList(const Value &listId) {
-    ListDef &theList = getList(listId.value);
+    ListDef &theList = getMutableList(listId.value);
     ListItemSorter sorter(*this);
     std::sort(theList.items.begin(), theList.items.end(), sorter);
 }
@@ -2,11 +2,14 @@
 #define GAMEDATA_H
 
 #include <array>
+#include <iosfwd>
 #include <string>
 #include <map>
+#include <memory>
 #include <vector>
 #include "bytestream.h"
 #include "gameerror.h"
+#include "random.h"
 #include "stack.h"
 #include "value.h"
 
@@ -27,20 +30,52 @@ const int SETTING_INFOBAR_RIGHT  = 2;
 const int SETTING_INFOBAR_FOOTER = 3;
 const int SETTING_INFOBAR_TITLE  = 4;
 
+const int HEAP_STRINGS = 0;
+const int HEAP_LISTS   = 1;
+const int HEAP_MAPS    = 2;
+const int HEAP_OBJECTS = 3;
+const int HEAP_TYPES   = 4;
+
+// statistics available through the heap_stats opcode; those for a single
+// type of item are numbered from a base plus the HEAP_ type number
+const int HEAPSTAT_COLLECTIONS   = 0;
+const int HEAPSTAT_MARK_TIME     = 1;
+const int HEAPSTAT_SWEEP_TIME    = 2;
+const int HEAPSTAT_GC_TIME       = 3;
+const int HEAPSTAT_HIGH_WATER    = 4;
+const int HEAPSTAT_TURN_CREATED  = 5;
+const int HEAPSTAT_TURNS         = 6;
+const int HEAPSTAT_LIVE          = 8;
+const int HEAPSTAT_BYTES         = 12;
+const int HEAPSTAT_LAST_FREED    = 16;
+const int HEAPSTAT_FREED         = 20;
+const int HEAPSTAT_CREATED       = 24;
+const int HEAPSTAT_COUNT         = 28;
+
 const int PROP_INTERNAL_NAME     = 1;
 const int PROP_IDENT             = 2;
 const int PROP_PROTOTYPE         = 3;
 
 struct GameData;
+class OpcodeProfile;
+class FunctionProfile;
+class SampleProfile;
+class Trace;
 
 struct DataItem {
     DataItem()
-    : ident(-1), srcFile(-1), srcLine(-1), srcName(-1), gcMark(false), isStatic(false) { }
+    : ident(-1), srcFile(-1), srcLine(-1), srcName(-1), isStatic(false), owner(0),
+      allocFunction(-1), allocIP(0) { }
 
     unsigned ident;
     int srcFile, srcLine, srcName;
-    bool gcMark;
     bool isStatic;
+    // the fork generation of the game allowed to change this item in place
+    unsigned owner;
+    // the function and instruction that created a dynamic item; only
+    // recorded when the game tracks allocations, otherwise -1
+    int allocFunction;
+    unsigned allocIP;
 };
 
 struct StringDef : public DataItem {
@@ -70,7 +105,7 @@ struct ObjectDef : public DataItem  {
     std::map<unsigned, Value> properties;
     unsigned childId, parentId, siblingId;
 
-    Value get(GameData &gamedata, unsigned propId, bool checkPrototype = true) const;
+    Value get(const GameData &gamedata, unsigned propId, bool checkPrototype = true) const;
     bool has(unsigned propId) const;
     void set(unsigned propId, const Value &value);
 };
@@ -101,40 +136,90 @@ struct FileRecord {
 typedef std::vector<FileRecord> FileList;
 
 
+// Statistics about the heap items held by a game: its dynamic items plus its
+// copies of any static items it has changed. Live counts and sizes are as of
+// the last garbage collection plus any items created since. Times are in
+// microseconds.
+struct HeapStats {
+    HeapStats()
+    : live{}, bytes{}, lastFreed{}, freed{}, created{},
+      collections(0), lastMarkTime(0), lastSweepTime(0), markTime(0),
+      sweepTime(0), highWater(0), turns(0), turnCreated(0), maxTurnCreated(0)
+    { }
+    void itemCreated(int heapType) {
+        ++live[heapType];
+        ++created[heapType];
+        ++turnCreated;
+        if (turnCreated > maxTurnCreated) maxTurnCreated = turnCreated;
+    }
+    unsigned long long get(int statistic) const;
+    void write(std::ostream &out) const;
+
+    std::array<unsigned long long, HEAP_TYPES> live, bytes, lastFreed, freed, created;
+    unsigned long long collections;
+    unsigned long long lastMarkTime, lastSweepTime;
+    unsigned long long markTime, sweepTime;
+    unsigned long long highWater;       // most items live after a collection
+    unsigned long long turns;
+    unsigned long long turnCreated;     // items created so far this turn
+    unsigned long long maxTurnCreated;
+};
+
+// The parts of a loaded game that never change while it runs. A single image
+// is shared by every game forked from the one that loaded it.
+struct StoryImage {
+    ByteStream bytecode;
+    std::vector<FunctionDef> functions;     // indexed by function ident
+    std::vector<std::string> vocab;
+    std::vector<std::shared_ptr<const StringDef>> strings;  // indexed by ident
+    std::vector<std::shared_ptr<const ListDef>> lists;
+    std::vector<std::shared_ptr<const MapDef>> maps;
+    std::vector<std::shared_ptr<const ObjectDef>> objects;
+};
+
 struct GameData {
     GameData()
-    : showDebug(0), instructionCount(0), optionType(OptionType::None),
-      extraValue(0), gameLoaded(false), mainFunction(0),
+    : showDebug(0), instructionCount(0), trackAllocations(false), allocationIP(0),
+      opcodeProfile(nullptr), functionProfile(nullptr), sampleProfile(nullptr), trace(nullptr),
+      optionType(OptionType::None), extraValue(0), gameLoaded(false), mainFunction(0),
       staticStrings(0), staticLists(0), staticMaps(0), staticObjects(0),
       refGamename(0), refVersion(0), refAuthor(0), refGameid(0), refBuild(0),
-      mCallCount(0)
+      mCallCount(0), mGeneration(newGeneration())
     { }
-    ~GameData();
     void load(const std::string &filename);
     void dump() const;
+    GameData fork();
 
+    // heap items may be shared with forked copies of the game or still be
+    // part of the story image, so anything that changes an item must
+    // request it through the getMutable functions
     const StringDef& getString(int index) const;
-    StringDef& getString(int index);
+    StringDef& getMutableString(int index);
     const ListDef& getList(int index) const;
-    ListDef& getList(int index);
+    ListDef& getMutableList(int index);
     const MapDef& getMap(int index) const;
-    MapDef& getMap(int index);
+    MapDef& getMutableMap(int index);
     const ObjectDef& getObject(int index) const;
-    ObjectDef& getObject(int index);
+    ObjectDef& getMutableObject(int index);
     const FunctionDef& getFunction(int index) const;
-    FunctionDef& getFunction(int index);
-    const std::string& getVocab(int index) const;
+    std::string getVocab(int index) const;
     int getVocab(const std::string &text) const;
 
     int collectGarbage();
-    void mark(ObjectDef &object);
-    void mark(ListDef   &list);
-    void mark(MapDef    &map);
-    void mark(StringDef &str);
+    void markReachable();
+    void startTurn();
+    void mark(const ObjectDef &object);
+    void mark(const ListDef   &list);
+    void mark(const MapDef    &map);
+    void mark(const StringDef &str);
     void mark(const Value &value);
 
     std::string getSource(const Value &value);
     Value resume(bool pushValue, const Value &inValue);
+    template<bool profiled>
+    Value execute(bool pushValue, const Value &inValue);
+    void checkArgumentTypes(const FunctionDef &function, const std::vector<Value> &args) const;
+    Value readOperand(unsigned &IP);
     void setExtra(const Value &newValue);
     void say(const std::string &what);
     void say(const Value &what);
@@ -151,12 +236,33 @@ struct GameData {
     FileList getFileList();
     bool saveFileList(const FileList &files);
     Value getFile(const std::string &fileName);
+    bool readFile(const std::string &fileName, std::vector<int> &values);
     bool saveFile(const std::string &filename, const ListDef *list);
+    bool writeFile(const std::string &filename, const ListDef *list);
     bool deleteFile(const std::string &filename);
+    bool removeFile(const std::string &filename);
+
+    bool saveState(const std::string &filename);
+    bool loadState(const std::string &filename);
+    // list the reachable items by where they were created
+    void writeHeapReport(std::ostream &out);
+    bool writeHeapReport(const std::string &filename);
 
 
     bool showDebug;
     long instructionCount;
+    // record where each dynamic item is created, which runs the VM with the
+    // profilers' version of the interpreter loop
+    bool trackAllocations;
+    unsigned allocationIP;      // start of the instruction being run
+    HeapStats heapStats;
+    RandomGenerator random;
+    // not owned; nullptr unless profiling
+    OpcodeProfile *opcodeProfile;
+    FunctionProfile *functionProfile;
+    SampleProfile *sampleProfile;
+    // not owned; nullptr unless recording or replaying a trace
+    Trace *trace;
     OptionType optionType;
     std::vector<GameOption> options;
     int extraValue;
@@ -164,13 +270,13 @@ struct GameData {
 
     bool gameLoaded;
     int mainFunction;
-    std::map<int, StringDef*> strings;
-    std::map<int, ListDef*> lists;
-    std::map<int, MapDef*> maps;
-    std::map<int, ObjectDef*> objects;
-    std::map<int, FunctionDef> functions;
-    std::vector<std::string> vocab;
-    ByteStream bytecode;
+    std::shared_ptr<const StoryImage> image;
+    // dynamic items plus this game's copies of any static items it has
+    // changed; static items not found here are read from the image
+    std::map<int, std::shared_ptr<StringDef>> strings;
+    std::map<int, std::shared_ptr<ListDef>> lists;
+    std::map<int, std::shared_ptr<MapDef>> maps;
+    std::map<int, std::shared_ptr<ObjectDef>> objects;
     unsigned staticStrings;
     unsigned staticLists;
     unsigned staticMaps;
@@ -188,9 +294,25 @@ struct GameData {
     std::array<std::string, INFO_COUNT> infoText;
     gtCallStack callStack;
 private:
+    static unsigned newGeneration();
+    void setDynamicOrigin(DataItem &item);
+    template<class T>
+    T& getMutableItem(std::map<int, std::shared_ptr<T>> &items,
+                      const std::vector<std::shared_ptr<const T>> &statics,
+                      int index, const char *typeName);
+
     unsigned mCallCount;
+    unsigned mGeneration;
+    std::vector<bool> mMarkedStrings, mMarkedLists, mMarkedMaps, mMarkedObjects;
 };
 
-void gameloop(GameData &gamedata, bool doSilent);
+void startGame(GameData &gamedata);
+void assignHotkeys(GameData &gamedata);
+bool handleInput(GameData &gamedata, const std::string &rawInputText, Value &nextValue);
+void gameloop(GameData &gamedata, bool doSilent, const std::string &stateFile,
+              const std::string &heapReportFile);
+bool replay(GameData &gamedata, const std::string &scriptFile);
+void explore(GameData &gamedata, int maxDepth, int threadCount);
+void serve(GameData &gamedata, int threadCount);
 
 #endif
@@ -1,11 +1,16 @@
 #include <algorithm>
 #include <cctype>
+#include <chrono>
+#include <cstdio>
+#include <fstream>
 #include <iostream>
 #include <sstream>
 #include <string>
 #include "gamedata.h"
 #include "formatter.h"
+#include "probe.h"
 #include "textutil.h"
+#include "trace.h"
 
 int tryAsNumber(const std::string &s) {
     char *endPtr;
@@ -14,27 +19,118 @@ int tryAsNumber(const std::string &s) {
     return -1;
 }
 
-void gameloop(GameData &gamedata, bool doSilent) {
+// Give every option without a hotkey of its own a number; numbered options
+// are stored as negative hotkeys.
+void assignHotkeys(GameData &gamedata) {
+    int index = 1;
+    for (GameOption &option : gamedata.options) {
+        if (option.hotkey > 0) {
+            option.hotkey = std::toupper(option.hotkey);
+        } else {
+            option.hotkey = -index;
+            ++index;
+        }
+    }
+}
+
+// Convert a line of player input into the value to resume the game with.
+// Returns false if the input isn't valid for the current prompt.
+bool handleInput(GameData &gamedata, const std::string &rawInputText, Value &nextValue) {
+    std::string inputText(rawInputText);
+    strToLower(inputText);
+
+    switch(gamedata.optionType) {
+        case OptionType::EndOfProgram:
+            //should never occur
+            return false;
+        case OptionType::Key: {
+            int c = 0;
+            if (!inputText.empty()) {
+                c = getFirstCodepoint(inputText);
+                if (c >= 'A' && c <= 'Z') c += 32;
+            }
+            nextValue = Value(Value::Integer, c);
+            return true; }
+        case OptionType::Line: {
+            nextValue = gamedata.makeNewString(rawInputText);
+            return true; }
+        case OptionType::Choice: {
+            if (inputText.empty()) {
+                if (gamedata.options.size() == 1) {
+                    nextValue = gamedata.options.front().value;
+                    gamedata.setExtra(gamedata.options.front().extra);
+                    return true;
+                }
+                break;
+            }
+
+            int optNum = tryAsNumber(inputText);
+            if (optNum >= 0) {
+                // numbered choice
+                optNum = -optNum;
+                for (const GameOption &option : gamedata.options) {
+                    if (option.hotkey == optNum) {
+                        nextValue = option.value;
+                        gamedata.setExtra(option.extra);
+                        return true;
+                    }
+                }
+            } else if (inputText.size() == 1) {
+                char key = std::toupper(inputText[0]);
+                // hotkey choice
+                for (const GameOption &option : gamedata.options) {
+                    if (option.hotkey == key) {
+                        nextValue = option.value;
+                        gamedata.setExtra(option.extra);
+                        return true;
+                    }
+                }
+            }
+            break; }
+        default:
+            std::cerr << "Unknown option type " << static_cast<int>(gamedata.optionType) << '\n';
+            break;
+    }
+    return false;
+}
+
+void startGame(GameData &gamedata) {
     const FunctionDef &funcDef = gamedata.getFunction(gamedata.mainFunction);
     gamedata.callStack.create(funcDef, gamedata.mainFunction);
     gamedata.callStack.getStack().setArgs(std::vector<Value>{Value{Value::None, 0}}, funcDef.arg_count, funcDef.local_count);
     gamedata.callStack.callTop().IP = funcDef.position;
+}
+
+void gameloop(GameData &gamedata, bool doSilent, const std::string &stateFile,
+              const std::string &heapReportFile) {
+    // a call stack that's already in place was restored from a saved state
+    // and is waiting on input, so redisplay the current screen instead of
+    // running anything
+    bool wasRestored = !gamedata.callStack.isEmpty();
+    if (!wasRestored) {
+        startGame(gamedata);
+    }
 
     int garbageCounter = 0, garbageAmount = 0;
     Value nextValue;
     bool hasNext, hasValue = false, didGarbage = false;
     while (1) {
-        ++garbageCounter;
-        if (garbageCounter >= GARBAGE_FREQUENCY) {
-            garbageAmount = gamedata.collectGarbage();
-            garbageCounter = 0;
-            didGarbage = true;
-        } else didGarbage = false;
-        gamedata.textBuffer = "";
-        gamedata.options.clear();
-        gamedata.instructionCount = 0;
-        gamedata.resume(hasValue, nextValue);
-        hasValue = false;
+        PROBE_BEGIN("turn", 0);
+        if (wasRestored) {
+            wasRestored = false;
+            didGarbage = false;
+            gamedata.instructionCount = 0;
+        } else {
+            ++garbageCounter;
+            if (garbageCounter >= GARBAGE_FREQUENCY) {
+                garbageAmount = gamedata.collectGarbage();
+                garbageCounter = 0;
+                didGarbage = true;
+            } else didGarbage = false;
+            gamedata.startTurn();
+            gamedata.resume(hasValue, nextValue);
+            hasValue = false;
+        }
 
         if (!doSilent) {
             std::cout << "\n*** " << gamedata.infoText[INFO_TITLE] << " ***\n";
@@ -70,9 +166,16 @@ void gameloop(GameData &gamedata, bool doSilent) {
 
         switch(gamedata.optionType) {
             case OptionType::EndOfProgram:
+                if (!stateFile.empty()) {
+                    std::remove(stateFile.c_str());
+                }
+                if (gamedata.trace && gamedata.trace->isReplaying() && !gamedata.trace->atEnd()) {
+                    std::cerr << "The game ended before the end of the trace.\n";
+                }
                 if (!doSilent) {
                     std::cout << "\nProgram ended. Goodbye!\n";
                 }
+                PROBE_END("turn");
                 return;
             case OptionType::Key:
             case OptionType::Line: {
@@ -83,31 +186,47 @@ void gameloop(GameData &gamedata, bool doSilent) {
                 }
                 break; }
             case OptionType::Choice: {
+                assignHotkeys(gamedata);
                 if (doSilent) break;
                 std::cout << '\n';
-                int index = 1;
-                for (GameOption &option : gamedata.options) {
+                for (const GameOption &option : gamedata.options) {
                     if (option.hotkey > 0) {
-                        option.hotkey = std::toupper(option.hotkey);
                         std::cout << static_cast<char>(option.hotkey) << ") ";
-                        std::cout << gamedata.getString(option.strId).text << '\n';
                     } else {
-                        std::cout << index << ") ";
-                        std::cout << gamedata.getString(option.strId).text << '\n';
-                        option.hotkey = -index;
-                        ++index;
+                        std::cout << -option.hotkey << ") ";
                     }
+                    std::cout << gamedata.getString(option.strId).text << '\n';
                 }
                 break; }
             default:
                 ;
         }
 
+        if (!stateFile.empty()) {
+            gamedata.saveState(stateFile);
+        }
+        if (!heapReportFile.empty() && !gamedata.writeHeapReport(heapReportFile)) {
+            std::cerr << "Failed to write heap report to " << heapReportFile << ".\n";
+        }
+
+        PROBE_END("turn");
         hasNext = false;
         do {
             std::cout << "\n> ";
             std::string rawInputText;
-            std::getline(std::cin, rawInputText);
+            Trace *trace = gamedata.trace;
+            if (!trace || !trace->isReplaying()) {
+                PROBE_BEGIN("wait for input", 0);
+                std::getline(std::cin, rawInputText);
+                PROBE_END("wait for input");
+            }
+            if (trace && !trace->input(rawInputText)) {
+                std::cout << "\n[End of trace.]\n";
+                return;
+            }
+            if (trace && trace->isReplaying()) {
+                std::cout << rawInputText << '\n';
+            }
             std::string inputText(rawInputText);
             strToLower(inputText);
             if (inputText == "quit" || inputText == "q") {
@@ -116,69 +235,85 @@ void gameloop(GameData &gamedata, bool doSilent) {
                 }
                 return;
             }
+            hasNext = handleInput(gamedata, rawInputText, nextValue);
+            hasValue = hasNext;
+        } while (!hasNext);
+    }
 
-            switch(gamedata.optionType) {
-                case OptionType::EndOfProgram:
-                    //should never occur
-                    return;
-                case OptionType::Key: {
-                    int c = 0;
-                    if (!inputText.empty()) {
-                        c = getFirstCodepoint(inputText);
-                        if (c >= 'A' && c <= 'Z') c += 32;
-                    }
-                    nextValue = Value(Value::Integer, c);
-                    hasNext = true;
-                    hasValue = true;
-                    break; }
-                case OptionType::Line: {
-                    nextValue = gamedata.makeNewString(rawInputText);
-                    hasNext = true;
-                    hasValue = true;
-                    break; }
-                case OptionType::Choice: {
-                    if (inputText.empty()) {
-                        if (gamedata.options.size() == 1) {
-                            nextValue = gamedata.options.front().value;
-                            gamedata.setExtra(gamedata.options.front().extra);
-                            hasNext = true;
-                            hasValue = true;
-                        }
-                        break;
-                    }
+}
 
-                    int optNum = tryAsNumber(inputText);
-                    if (optNum >= 0) {
-                        // numbered choice
-                        optNum = -optNum;
-                        for (const GameOption &option : gamedata.options) {
-                            if (option.hotkey == optNum) {
-                                nextValue = option.value;
-                                gamedata.setExtra(option.extra);
-                                hasNext = true;
-                                hasValue = true;
-                                break;
-                            }
-                        }
-                    } else if (inputText.size() == 1) {
-                        char key = std::toupper(inputText[0]);
-                        // hotkey choice
-                        for (const GameOption &option : gamedata.options) {
-                            if (option.hotkey == key) {
-                                nextValue = option.value;
-                                gamedata.setExtra(option.extra);
-                                hasNext = true;
-                                hasValue = true;
-                                break;
-                            }
-                        }
-                    }
-                    break; }
-                default:
-                    std::cerr << "Unknown option type " << static_cast<int>(gamedata.optionType) << '\n';
-                    break;
+bool replay(GameData &gamedata, const std::string &scriptFile) {
+    std::ifstream script(scriptFile);
+    if (!script) {
+        std::cerr << "Could not open replay script ~" << scriptFile << "~.\n";
+        return false;
+    }
+
+    typedef std::chrono::steady_clock Clock;
+    Clock::duration gcTime(0);
+    Clock::time_point startTime = Clock::now();
+    long long totalInstructions = 0;
+    int garbageCounter = 0, garbageTotal = 0, lineNumber = 0, turns = 0;
+    Value nextValue;
+    bool hasValue = false;
+
+    // as in gameloop, a call stack that's already in place was restored from
+    // a saved state and is waiting on input, so the script's first line
+    // answers it instead of starting a new game
+    bool wasRestored = !gamedata.callStack.isEmpty();
+    if (!wasRestored) {
+        startGame(gamedata);
+    }
+    while (1) {
+        if (wasRestored) {
+            wasRestored = false;
+        } else {
+            PROBE_BEGIN("turn", 0);
+            ++garbageCounter;
+            if (garbageCounter >= GARBAGE_FREQUENCY) {
+                Clock::time_point gcStart = Clock::now();
+                garbageTotal += gamedata.collectGarbage();
+                gcTime += Clock::now() - gcStart;
+                garbageCounter = 0;
             }
-        } while (!hasNext);
+            gamedata.startTurn();
+            gamedata.resume(hasValue, nextValue);
+            totalInstructions += gamedata.instructionCount;
+            ++turns;
+            PROBE_END("turn");
+        }
+
+        if (gamedata.optionType == OptionType::EndOfProgram) break;
+        if (gamedata.optionType == OptionType::Choice) assignHotkeys(gamedata);
+
+        std::string inputText;
+        if (!std::getline(script, inputText)) break;
+        ++lineNumber;
+        hasValue = handleInput(gamedata, inputText, nextValue);
+        if (!hasValue) {
+            std::cerr << scriptFile << ':' << lineNumber << ": input \"" << inputText;
+            std::cerr << "\" is not valid for the current prompt.\n";
+            return false;
+        }
     }
 
+    Clock::duration wallTime = Clock::now() - startTime;
+    std::cout << "Replayed " << lineNumber << " inputs over " << turns << " turns; ";
+    if (gamedata.optionType == OptionType::EndOfProgram) {
+        std::cout << "the game ended.\n";
+        std::string unusedText;
+        if (std::getline(script, unusedText)) {
+            std::cerr << scriptFile << ':' << lineNumber + 1;
+            std::cerr << ": game ended before end of script.\n";
+        }
+    } else {
+        std::cout << "the script ended before the game did.\n";
+    }
+    std::cout << "    instructions executed:  " << totalInstructions << '\n';
+    std::cout << "    wall time:              ";
+    std::cout << std::chrono::duration<double, std::milli>(wallTime).count() << " ms\n";
+    std::cout << "    garbage collection:     ";
+    std::cout << std::chrono::duration<double, std::milli>(gcTime).count() << " ms (";
+    std::cout << garbageTotal << " items collected)\n";
+    return true;
 }
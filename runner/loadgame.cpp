@@ -1,10 +1,12 @@
 #include <fstream>
 #include <iostream>
 #include <map>
+#include <memory>
 #include <vector>
 
 #include "gamedata.h"
 #include "bytestream.h"
+#include "probe.h"
 #include "value.h"
 
 const unsigned char STRING_XOR_KEY = 0x7B;
@@ -15,8 +17,16 @@ uint8_t read_8(std::istream &in);
 std::string read_str(std::istream &in);
 Value read_value(std::istream &in);
 
+// Static items are stored in the story image indexed by their ident.
+template<class T>
+static void addStatic(std::vector<std::shared_ptr<const T>> &statics, std::shared_ptr<T> item) {
+    if (item->ident >= statics.size()) statics.resize(item->ident + 1);
+    statics[item->ident] = item;
+}
+
 
 void GameData::load(const std::string &filename) {
+    PROBE_SCOPE("load game", 0);
     std::ifstream inf(filename, std::ios_base::binary);
     if (!inf) {
         std::cerr << "Could not open ~" << filename << "~.\n";
@@ -44,31 +54,32 @@ void GameData::load(const std::string &filename) {
 
     // skip header
     inf.seekg(HEADER_SIZE);
+    std::shared_ptr<StoryImage> newImage = std::make_shared<StoryImage>();
 
     // READ STRINGS
     nextString = 1;
     staticStrings = read_32(inf);
     for (unsigned i = 0; i < staticStrings; ++i) {
-        StringDef *def = new StringDef;
+        std::shared_ptr<StringDef> def = std::make_shared<StringDef>();
         def->ident = i;
         def->isStatic = true;
         if (def->ident >= nextString) nextString = def->ident + 1;
         def->text = read_str(inf);
-        strings.insert(std::make_pair(def->ident, def));
+        addStatic(newImage->strings, def);
     }
 
     // READ VOCAB
     staticVocab = read_32(inf);
     for (unsigned i = 0; i < staticVocab; ++i) {
         std::string word = read_str(inf);
-        vocab.push_back(word);
+        newImage->vocab.push_back(word);
     }
 
     // // READ LISTS
     nextList = 1;
     staticLists = read_32(inf);
     for (unsigned i = 0; i < staticLists; ++i) {
-        ListDef *def = new ListDef;
+        std::shared_ptr<ListDef> def = std::make_shared<ListDef>();
         def->isStatic = true;
         def->srcName = -1;
         def->srcFile = read_32(inf);
@@ -82,14 +93,14 @@ void GameData::load(const std::string &filename) {
             value.value = read_32(inf);
             def->items.push_back(value);
         }
-        lists.insert(std::make_pair(def->ident, def));
+        addStatic(newImage->lists, def);
     }
 
     // READ MAPS
     nextMap = 1;
     staticMaps = read_32(inf);
     for (unsigned i = 0; i < staticMaps; ++i) {
-        MapDef *def = new MapDef;
+        std::shared_ptr<MapDef> def = std::make_shared<MapDef>();
         def->isStatic = true;
         def->srcName = -1;
         def->srcFile = read_32(inf);
@@ -105,14 +116,14 @@ void GameData::load(const std::string &filename) {
             v2.value = read_32(inf);
             def->rows.push_back(MapDef::Row{v1,v2});
         }
-        maps.insert(std::make_pair(def->ident, def));
+        addStatic(newImage->maps, def);
     }
 
     // READ OBJECTS
     nextObject = 1;
     staticObjects = read_32(inf);
     for (unsigned i = 0; i < staticObjects; ++i) {
-        ObjectDef *def = new ObjectDef;
+        std::shared_ptr<ObjectDef> def = std::make_shared<ObjectDef>();
         def->isStatic = true;
         def->srcName = read_32(inf);
         def->srcFile = read_32(inf);
@@ -130,7 +141,7 @@ void GameData::load(const std::string &filename) {
             value.value = read_32(inf);
             def->properties.insert(std::make_pair(propId, value));
         }
-        objects.insert(std::make_pair(def->ident, def));
+        addStatic(newImage->objects, def);
     }
 
     // READ FUNCTION HEADERS
@@ -148,13 +159,16 @@ void GameData::load(const std::string &filename) {
             def.argTypes.push_back(static_cast<Value::Type>(read_8(inf)));
         }
         def.position = read_32(inf);
-        functions.insert(std::make_pair(def.ident, def));
+        if (def.ident >= newImage->functions.size()) {
+            newImage->functions.resize(def.ident + 1);
+        }
+        newImage->functions[def.ident] = def;
     }
 
     // READ FUNCTION BYTECODE
     unsigned bytecodeSize = read_32(inf);
     for (unsigned i = 0; i < bytecodeSize; ++i) {
-        bytecode.add_8(read_8(inf));
+        newImage->bytecode.add_8(read_8(inf));
     }
 
     // VERIFY END OF FILE
@@ -164,6 +178,7 @@ void GameData::load(const std::string &filename) {
         return;
     }
 
+    image = newImage;
     noneValue = Value();
     gameLoaded = true;
 }
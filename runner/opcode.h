@@ -3,6 +3,13 @@
 
 #include <string>
 
+// where the operands of register_op come from and where its result goes
+const int REGISTER_STACK            = 0;
+const int REGISTER_LOCAL            = 1;
+const int REGISTER_CONSTANT         = 2;
+const int REGISTER_JUMP_ZERO        = 3;
+const int REGISTER_JUMP_NOT_ZERO    = 4;
+
 struct OpcodeDef {
     enum CodeOpcode {
         Return              = 0,
@@ -78,7 +85,9 @@ struct OpcodeDef {
         StringCompare       = 68,
         Error               = 69,
         Origin              = 70,
-        // unused: 71, 72, 73
+        CallDirect          = 71, // call a known function; callee and argument count follow
+        TailCall            = 72, // call, replacing the current function
+        TailCallDirect      = 73, // call_direct, replacing the current function
         New                 = 74,
         StringAppendUF      = 75,
         IsStatic            = 76,
@@ -95,6 +104,8 @@ struct OpcodeDef {
         GetChildren         = 87,
         GetChildCount       = 88,
         MoveTo              = 89,
+        RegisterOp          = 90, // binary operation on locals and constants
+        HeapStat            = 91, // get garbage collection and heap statistics
     };
 
     std::string name;
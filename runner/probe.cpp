@@ -0,0 +1,96 @@
+#include <chrono>
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <string>
+
+#include "gamedata.h"
+#include "probe.h"
+#include "profile.h"
+
+#ifdef RATVM_PROBES
+ProbeBuffer probeBuffer;
+#endif
+
+ProbeBuffer::ProbeBuffer()
+: events(CAPACITY), count(0), startTime(0)
+{
+    startTime = now();
+}
+
+uint64_t ProbeBuffer::now() const {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+                std::chrono::steady_clock::now().time_since_epoch()).count() - startTime;
+}
+
+// small numbers are easier to read in a trace viewer than real thread ids
+int ProbeBuffer::threadId() {
+    static std::atomic<int> nextThread(1);
+    thread_local int thread = nextThread.fetch_add(1);
+    return thread;
+}
+
+static void writeJSONString(std::ostream &out, const std::string &text) {
+    out << '"';
+    for (char c : text) {
+        if (c == '"' || c == '\\') {
+            out << '\\' << c;
+        } else if (static_cast<unsigned char>(c) < 0x20) {
+            char escape[8];
+            std::snprintf(escape, sizeof(escape), "\\u%04x", c);
+            out << escape;
+        } else {
+            out << c;
+        }
+    }
+    out << '"';
+}
+
+bool ProbeBuffer::writeChromeTrace(const std::string &filename, const GameData &gamedata) const {
+    std::ofstream out(filename);
+    if (!out) return false;
+
+    uint64_t total = count.load();
+    uint64_t first = total > CAPACITY ? total - CAPACITY : 0;
+    if (first > 0) {
+        std::cerr << "Probe buffer overflowed; only the last " << CAPACITY;
+        std::cerr << " of " << total << " events were kept.\n";
+    }
+
+    out << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[";
+    bool firstEvent = true;
+    // spans open on each thread; an end whose beginning was overwritten
+    // would otherwise close the wrong span
+    std::map<int, int> depth;
+    for (uint64_t i = first; i < total; ++i) {
+        const Event &event = events[i & (CAPACITY - 1)];
+        if (event.phase == 'B') {
+            ++depth[event.thread];
+        } else if (event.phase == 'E') {
+            if (depth[event.thread] == 0) continue;
+            --depth[event.thread];
+        }
+        out << (firstEvent ? "\n" : ",\n");
+        firstEvent = false;
+        out << "{\"name\":";
+        if (event.name) {
+            writeJSONString(out, event.name);
+            out << ",\"cat\":\"vm\"";
+        } else if (event.phase == 'B') {
+            writeJSONString(out, functionName(gamedata, event.value));
+            out << ",\"cat\":\"function\"";
+        } else {
+            out << "\"\",\"cat\":\"function\"";
+        }
+        char time[32];
+        std::snprintf(time, sizeof(time), "%.3f", event.time / 1000.0);
+        out << ",\"ph\":\"" << event.phase << "\",\"ts\":" << time;
+        out << ",\"pid\":1,\"tid\":" << event.thread;
+        if (event.phase == 'i') out << ",\"s\":\"t\"";
+        if (event.phase != 'E') out << ",\"args\":{\"value\":" << event.value << '}';
+        out << '}';
+    }
+    out << "\n]}\n";
+    return static_cast<bool>(out);
+}
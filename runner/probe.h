@@ -0,0 +1,96 @@
+#ifndef PROBE_H
+#define PROBE_H
+
+#include <atomic>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// Trace points in the VM, garbage collector, loader, and file functions for
+// lining up slow turns with what the VM was doing at the time. The probes
+// compile to nothing unless the runner is built with make PROBES=1, so they
+// may be placed on paths as hot as function calls.
+//
+// Each probe writes a fixed-size event to a ring buffer shared by every
+// thread; once the buffer fills, the oldest events are overwritten. The
+// buffer is written out in the Chrome trace event format when the runner
+// exits, for viewing in chrome://tracing or Perfetto.
+
+struct GameData;
+
+class ProbeBuffer {
+public:
+    static const unsigned CAPACITY = 1 << 18;   // must be a power of two
+
+    ProbeBuffer();
+
+    // phase is the trace event phase: 'B' to begin a span, 'E' to end the
+    // most recent one begun on the same thread, or 'i' for a single moment;
+    // a null name marks a call to the function whose id is value
+    void record(char phase, const char *name, int value) {
+        uint64_t index = count.fetch_add(1, std::memory_order_relaxed);
+        Event &event = events[index & (CAPACITY - 1)];
+        event.time = now();
+        event.name = name;
+        event.value = value;
+        event.thread = threadId();
+        event.phase = phase;
+    }
+
+    // function names are looked up in gamedata
+    bool writeChromeTrace(const std::string &filename, const GameData &gamedata) const;
+
+private:
+    struct Event {
+        uint64_t time;      // nanoseconds since the buffer was created
+        const char *name;
+        int value;
+        int thread;
+        char phase;
+    };
+
+    uint64_t now() const;
+    static int threadId();
+
+    std::vector<Event> events;
+    std::atomic<uint64_t> count;
+    uint64_t startTime;
+};
+
+#ifdef RATVM_PROBES
+
+extern ProbeBuffer probeBuffer;
+
+// Ends a span when it goes out of scope, including by an exception.
+struct ProbeScope {
+    ProbeScope(const char *name, int value) : name(name) {
+        probeBuffer.record('B', name, value);
+    }
+    ~ProbeScope() {
+        probeBuffer.record('E', name, 0);
+    }
+    const char *name;
+};
+
+#define PROBE_JOIN2(a, b) a##b
+#define PROBE_JOIN(a, b) PROBE_JOIN2(a, b)
+
+#define PROBE_BEGIN(name, value)    probeBuffer.record('B', name, value)
+#define PROBE_END(name)             probeBuffer.record('E', name, 0)
+#define PROBE_EVENT(name, value)    probeBuffer.record('i', name, value)
+#define PROBE_SCOPE(name, value)    ProbeScope PROBE_JOIN(probeScope, __LINE__)(name, value)
+#define PROBE_CALL(functionId)      probeBuffer.record('B', nullptr, functionId)
+#define PROBE_RETURN()              probeBuffer.record('E', nullptr, 0)
+
+#else
+
+#define PROBE_BEGIN(name, value)    ((void)0)
+#define PROBE_END(name)             ((void)0)
+#define PROBE_EVENT(name, value)    ((void)0)
+#define PROBE_SCOPE(name, value)    ((void)0)
+#define PROBE_CALL(functionId)      ((void)0)
+#define PROBE_RETURN()              ((void)0)
+
+#endif
+
+#endif
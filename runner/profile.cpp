@@ -0,0 +1,456 @@
+#include <algorithm>
+#include <cctype>
+#include <fstream>
+#include <iomanip>
+#include <ostream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#if defined(__linux__) || (defined(__APPLE__) && defined(__MACH__))
+#include <signal.h>
+#include <sys/time.h>
+#endif
+
+#include "gamedata.h"
+#include "opcode.h"
+#include "profile.h"
+#include "stack.h"
+
+OpcodeProfile::OpcodeProfile()
+: counts(OPCODE_COUNT), cycles(OPCODE_COUNT),
+  pairs(OPCODE_COUNT * OPCODE_COUNT), lastOpcode(-1), lastTime(0)
+{ }
+
+const char* OpcodeProfile::clockUnit() {
+#if defined(__x86_64__) || defined(__i386__)
+    return "cycles";
+#else
+    return "ns";
+#endif
+}
+
+static std::string opcodeName(int code) {
+    const OpcodeDef *def = getOpcodeByCode(code);
+    if (def) return def->name;
+    std::stringstream ss;
+    ss << "op_" << code;
+    return ss.str();
+}
+
+// Get the indexes of the non-zero entries of a table, largest first.
+static std::vector<int> sortedIndexes(const std::vector<uint64_t> &table) {
+    std::vector<int> indexes;
+    for (unsigned i = 0; i < table.size(); ++i) {
+        if (table[i] > 0) indexes.push_back(i);
+    }
+    std::stable_sort(indexes.begin(), indexes.end(), [&table](int a, int b) {
+        return table[a] > table[b];
+    });
+    return indexes;
+}
+
+void OpcodeProfile::writeTable(std::ostream &out, unsigned maxPairs) const {
+    uint64_t totalCount = 0, totalCycles = 0;
+    for (int i = 0; i < OPCODE_COUNT; ++i) {
+        totalCount += counts[i];
+        totalCycles += cycles[i];
+    }
+
+    out << "OPCODE PROFILE: " << totalCount << " opcodes executed in ";
+    out << totalCycles << ' ' << clockUnit() << "\n\n";
+    out << std::left << std::setw(18) << "opcode" << std::right;
+    out << std::setw(14) << "count" << std::setw(18) << clockUnit();
+    out << std::setw(8) << "time%" << std::setw(12) << "average" << '\n';
+    out << std::fixed;
+    for (int code : sortedIndexes(cycles)) {
+        out << std::left << std::setw(18) << opcodeName(code) << std::right;
+        out << std::setw(14) << counts[code];
+        out << std::setw(18) << cycles[code];
+        out << std::setw(8) << std::setprecision(2);
+        out << (totalCycles ? 100.0 * cycles[code] / totalCycles : 0.0);
+        out << std::setw(12) << std::setprecision(1);
+        out << (counts[code] ? static_cast<double>(cycles[code]) / counts[code] : 0.0);
+        out << '\n';
+    }
+
+    out << "\nMOST COMMON OPCODE PAIRS:\n";
+    std::vector<int> pairOrder = sortedIndexes(pairs);
+    if (pairOrder.size() > maxPairs) pairOrder.resize(maxPairs);
+    for (int pair : pairOrder) {
+        std::string name = opcodeName(pair / OPCODE_COUNT) + " -> "
+                         + opcodeName(pair % OPCODE_COUNT);
+        out << "    " << std::left << std::setw(36) << name << std::right;
+        out << std::setw(14) << pairs[pair] << '\n';
+    }
+    out << std::defaultfloat;
+}
+
+bool OpcodeProfile::writeJSON(const std::string &filename) const {
+    std::ofstream out(filename);
+    if (!out) return false;
+
+    out << "{\n    \"clock\": \"" << clockUnit() << "\",\n";
+    out << "    \"opcodes\": [";
+    bool first = true;
+    for (int code : sortedIndexes(counts)) {
+        if (!first) out << ',';
+        first = false;
+        out << "\n        { \"code\": " << code;
+        out << ", \"name\": \"" << opcodeName(code) << '"';
+        out << ", \"count\": " << counts[code];
+        out << ", \"time\": " << cycles[code] << " }";
+    }
+    out << "\n    ],\n    \"pairs\": [";
+    first = true;
+    for (int pair : sortedIndexes(pairs)) {
+        if (!first) out << ',';
+        first = false;
+        out << "\n        { \"first\": \"" << opcodeName(pair / OPCODE_COUNT) << '"';
+        out << ", \"second\": \"" << opcodeName(pair % OPCODE_COUNT) << '"';
+        out << ", \"count\": " << pairs[pair] << " }";
+    }
+    out << "\n    ]\n}\n";
+    return static_cast<bool>(out);
+}
+
+
+FunctionProfile::FunctionProfile()
+: current(0), lastCount(0), lastTime(0)
+{
+    nodes.push_back(Node(-1, -1));
+}
+
+uint64_t FunctionProfile::now() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+                std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+int FunctionProfile::child(int parent, int functionId) {
+    auto iter = nodes[parent].children.find(functionId);
+    if (iter != nodes[parent].children.end()) return iter->second;
+    int index = nodes.size();
+    nodes.push_back(Node(functionId, parent));
+    nodes[parent].children.insert(std::make_pair(functionId, index));
+    return index;
+}
+
+void FunctionProfile::charge(long instructionCount) {
+    uint64_t time = now();
+    nodes[current].instructions += instructionCount - lastCount;
+    nodes[current].time += time - lastTime;
+    lastCount = instructionCount;
+    lastTime = time;
+}
+
+void FunctionProfile::start(const gtCallStack &callStack, long instructionCount) {
+    // the call stack only changes outside the VM when a game is started or
+    // restored, so any function that's new here was just called
+    current = 0;
+    for (int i = 0; i < callStack.size(); ++i) {
+        unsigned oldSize = nodes.size();
+        current = child(current, callStack[i].functionId);
+        if (nodes.size() != oldSize) ++nodes[current].calls;
+    }
+    lastCount = instructionCount;
+    lastTime = now();
+}
+
+void FunctionProfile::stop(long instructionCount) {
+    charge(instructionCount);
+}
+
+void FunctionProfile::enter(int functionId, bool isTailCall, long instructionCount) {
+    charge(instructionCount);
+    if (isTailCall && current > 0) current = nodes[current].parent;
+    current = child(current, functionId);
+    ++nodes[current].calls;
+}
+
+void FunctionProfile::leave(long instructionCount) {
+    charge(instructionCount);
+    if (current > 0) current = nodes[current].parent;
+}
+
+// Visit every node depth first, calling visit(node, true) before its
+// children and visit(node, false) after them. This doesn't recurse since
+// call chains can be far deeper than the native stack.
+template<class Visitor>
+void FunctionProfile::walk(Visitor visit) const {
+    typedef std::map<int, int>::const_iterator ChildIter;
+    std::vector<std::pair<int, ChildIter>> pending;
+    visit(0, true);
+    pending.push_back(std::make_pair(0, nodes[0].children.begin()));
+    while (!pending.empty()) {
+        int node = pending.back().first;
+        ChildIter &next = pending.back().second;
+        if (next == nodes[node].children.end()) {
+            visit(node, false);
+            pending.pop_back();
+            continue;
+        }
+        int childNode = next->second;
+        ++next;
+        visit(childNode, true);
+        pending.push_back(std::make_pair(childNode, nodes[childNode].children.begin()));
+    }
+}
+
+std::string functionName(const GameData &gamedata, int functionId) {
+    const FunctionDef &function = gamedata.getFunction(functionId);
+    if (function.srcName >= 0) return gamedata.getString(function.srcName).text;
+    std::stringstream ss;
+    ss << '#' << functionId;
+    return ss.str();
+}
+
+// The name of a function as a frame of a collapsed stack, which may not
+// contain the separators used by the format.
+static std::string frameName(const GameData &gamedata, int functionId) {
+    std::string name = functionName(gamedata, functionId);
+    for (char &c : name) {
+        if (c == ';' || std::isspace(static_cast<unsigned char>(c))) c = '_';
+    }
+    return name;
+}
+
+void FunctionProfile::writeTable(std::ostream &out, const GameData &gamedata) const {
+    struct Totals {
+        uint64_t calls, selfCount, totalCount, selfTime, totalTime, selfAlloc, totalAlloc;
+    };
+
+    // the values for each node including those of the functions it called
+    std::vector<uint64_t> count(nodes.size()), time(nodes.size()), alloc(nodes.size());
+    for (int i = nodes.size() - 1; i >= 0; --i) {
+        count[i] += nodes[i].instructions;
+        time[i] += nodes[i].time;
+        alloc[i] += nodes[i].allocations;
+        if (i > 0) {
+            count[nodes[i].parent] += count[i];
+            time[nodes[i].parent] += time[i];
+            alloc[nodes[i].parent] += alloc[i];
+        }
+    }
+
+    // a recursive call is already included in the totals of the outermost
+    // call to the same function
+    std::map<int, Totals> totals;
+    std::map<int, int> active;
+    walk([&](int node, bool entering) {
+        int functionId = nodes[node].functionId;
+        if (functionId < 0) return;
+        if (!entering) {
+            --active[functionId];
+            return;
+        }
+        Totals &t = totals.insert(std::make_pair(functionId, Totals{})).first->second;
+        t.calls += nodes[node].calls;
+        t.selfCount += nodes[node].instructions;
+        t.selfTime += nodes[node].time;
+        t.selfAlloc += nodes[node].allocations;
+        if (active[functionId] == 0) {
+            t.totalCount += count[node];
+            t.totalTime += time[node];
+            t.totalAlloc += alloc[node];
+        }
+        ++active[functionId];
+    });
+
+    std::vector<std::pair<int, Totals>> order(totals.begin(), totals.end());
+    std::stable_sort(order.begin(), order.end(),
+            [](const std::pair<int, Totals> &a, const std::pair<int, Totals> &b) {
+        return a.second.selfTime > b.second.selfTime;
+    });
+
+    out << "FUNCTION PROFILE: " << count[0] << " opcodes executed in ";
+    out << std::fixed << std::setprecision(3) << time[0] / 1000000.0 << " ms\n\n";
+    out << std::setw(10) << "calls";
+    out << std::setw(13) << "self ops" << std::setw(13) << "total ops";
+    out << std::setw(11) << "self ms" << std::setw(11) << "total ms";
+    out << std::setw(10) << "self new" << std::setw(10) << "total new";
+    out << "  function\n";
+    for (const auto &entry : order) {
+        const FunctionDef &function = gamedata.getFunction(entry.first);
+        std::stringstream name;
+        name << functionName(gamedata, entry.first);
+        if (function.srcFile >= 0) {
+            name << " (" << gamedata.getString(function.srcFile).text;
+            if (function.srcLine >= 0) name << ':' << function.srcLine;
+            name << ')';
+        }
+        const Totals &t = entry.second;
+        out << std::setw(10) << t.calls;
+        out << std::setw(13) << t.selfCount << std::setw(13) << t.totalCount;
+        out << std::setw(11) << t.selfTime / 1000000.0;
+        out << std::setw(11) << t.totalTime / 1000000.0;
+        out << std::setw(10) << t.selfAlloc << std::setw(10) << t.totalAlloc;
+        out << "  " << name.str() << '\n';
+    }
+    out << std::defaultfloat;
+}
+
+bool FunctionProfile::writeCollapsed(const std::string &filename, const GameData &gamedata) const {
+    std::ofstream out(filename);
+    if (!out) return false;
+
+    std::vector<std::string> path;
+    walk([&](int node, bool entering) {
+        if (node == 0) return;
+        if (!entering) {
+            path.pop_back();
+            return;
+        }
+        path.push_back(frameName(gamedata, nodes[node].functionId));
+        if (nodes[node].instructions == 0) return;
+        for (unsigned i = 0; i < path.size(); ++i) {
+            if (i > 0) out << ';';
+            out << path[i];
+        }
+        out << ' ' << nodes[node].instructions << '\n';
+    });
+    return static_cast<bool>(out);
+}
+
+
+std::atomic<bool> SampleProfile::sampleDue(false);
+
+#if defined(__linux__) || (defined(__APPLE__) && defined(__MACH__))
+static void onProfileTimer(int) {
+    SampleProfile::requestSample();
+}
+#endif
+
+SampleProfile::SampleProfile()
+: buffer(BUFFER_SIZE), bufferCount(0), checks(0), sampleCount(0)
+{
+#if defined(__linux__) || (defined(__APPLE__) && defined(__MACH__))
+    struct sigaction action = {};
+    action.sa_handler = onProfileTimer;
+    action.sa_flags = SA_RESTART;
+    sigemptyset(&action.sa_mask);
+    sigaction(SIGPROF, &action, nullptr);
+
+    struct itimerval timer = {};
+    timer.it_interval.tv_usec = INTERVAL_USEC;
+    timer.it_value.tv_usec = INTERVAL_USEC;
+    setitimer(ITIMER_PROF, &timer, nullptr);
+#endif
+}
+
+SampleProfile::~SampleProfile() {
+#if defined(__linux__) || (defined(__APPLE__) && defined(__MACH__))
+    struct itimerval timer = {};
+    setitimer(ITIMER_PROF, &timer, nullptr);
+    signal(SIGPROF, SIG_DFL);
+#endif
+}
+
+void SampleProfile::take(const gtCallStack &callStack, unsigned IP) {
+    clearDue();
+    if (callStack.isEmpty()) return;
+    if (bufferCount >= buffer.size()) tally();
+
+    Sample &sample = buffer[bufferCount];
+    ++bufferCount;
+    int top = callStack.size() - 1;
+    sample.depth = 0;
+    sample.truncated = callStack.size() > MAX_DEPTH;
+    for (int i = top; i >= 0 && sample.depth < MAX_DEPTH; --i) {
+        const gtCallStack::Frame &frame = callStack[i];
+        // the saved IP of the running function is out of date
+        unsigned frameIP = i == top ? IP : frame.IP;
+        Frame &out = sample.frames[sample.depth];
+        out.functionId = frame.functionId;
+        out.offset = frameIP - frame.funcDef.position;
+        ++sample.depth;
+    }
+}
+
+// Move the buffered samples into the totals.
+void SampleProfile::tally() {
+    std::vector<int> stack;
+    for (unsigned i = 0; i < bufferCount; ++i) {
+        const Sample &sample = buffer[i];
+        stack.clear();
+        if (sample.truncated) stack.push_back(-1);
+        for (int j = sample.depth - 1; j >= 0; --j) {
+            stack.push_back(sample.frames[j].functionId);
+        }
+        ++stacks[stack];
+        ++spots[std::make_pair(sample.frames[0].functionId, sample.frames[0].offset)];
+        ++sampleCount;
+    }
+    bufferCount = 0;
+}
+
+void SampleProfile::writeTable(std::ostream &out, const GameData &gamedata, unsigned maxSpots) {
+    tally();
+
+    std::map<int, uint64_t> selfSamples, totalSamples;
+    for (const auto &entry : stacks) {
+        const std::vector<int> &stack = entry.first;
+        selfSamples[stack.back()] += entry.second;
+        // count each function once per sample, even if it's recursive
+        std::vector<int> seen;
+        for (int functionId : stack) {
+            if (std::find(seen.begin(), seen.end(), functionId) != seen.end()) continue;
+            seen.push_back(functionId);
+            totalSamples[functionId] += entry.second;
+        }
+    }
+    std::vector<int> order;
+    for (const auto &entry : totalSamples) {
+        if (entry.first >= 0) order.push_back(entry.first);
+    }
+    std::stable_sort(order.begin(), order.end(), [&selfSamples](int a, int b) {
+        return selfSamples[a] > selfSamples[b];
+    });
+
+    out << "SAMPLE PROFILE: " << sampleCount << " samples taken\n\n";
+    out << std::setw(10) << "self" << std::setw(9) << "self%";
+    out << std::setw(10) << "total" << std::setw(9) << "total%" << "  function\n";
+    out << std::fixed << std::setprecision(2);
+    for (int functionId : order) {
+        uint64_t self = selfSamples[functionId], total = totalSamples[functionId];
+        out << std::setw(10) << self;
+        out << std::setw(9) << (sampleCount ? 100.0 * self / sampleCount : 0.0);
+        out << std::setw(10) << total;
+        out << std::setw(9) << (sampleCount ? 100.0 * total / sampleCount : 0.0);
+        out << "  " << functionName(gamedata, functionId) << '\n';
+    }
+
+    out << "\nBUSIEST CODE (function+offset):\n";
+    std::vector<std::pair<std::pair<int, unsigned>, uint64_t>> spotOrder(spots.begin(), spots.end());
+    std::stable_sort(spotOrder.begin(), spotOrder.end(),
+            [](const std::pair<std::pair<int, unsigned>, uint64_t> &a,
+               const std::pair<std::pair<int, unsigned>, uint64_t> &b) {
+        return a.second > b.second;
+    });
+    if (spotOrder.size() > maxSpots) spotOrder.resize(maxSpots);
+    for (const auto &spot : spotOrder) {
+        std::stringstream name;
+        name << functionName(gamedata, spot.first.first) << '+' << spot.first.second;
+        out << "    " << std::left << std::setw(40) << name.str() << std::right;
+        out << std::setw(10) << spot.second;
+        out << std::setw(9) << (sampleCount ? 100.0 * spot.second / sampleCount : 0.0);
+        out << '\n';
+    }
+    out << std::defaultfloat;
+}
+
+bool SampleProfile::writeCollapsed(const std::string &filename, const GameData &gamedata) {
+    tally();
+    std::ofstream out(filename);
+    if (!out) return false;
+
+    for (const auto &entry : stacks) {
+        bool first = true;
+        for (int functionId : entry.first) {
+            if (!first) out << ';';
+            first = false;
+            out << (functionId < 0 ? "..." : frameName(gamedata, functionId));
+        }
+        out << ' ' << entry.second << '\n';
+    }
+    return static_cast<bool>(out);
+}
@@ -0,0 +1,189 @@
+#ifndef PROFILE_H
+#define PROFILE_H
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <iosfwd>
+#include <map>
+#include <string>
+#include <vector>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+// Execution counts and times for each opcode run by the VM, plus the number
+// of times each opcode was directly followed by each other opcode. Only
+// collected when the runner is started with -profile.
+class OpcodeProfile {
+public:
+    static const int OPCODE_COUNT = 256;
+
+    OpcodeProfile();
+
+    // the time stamp counter where there is one, otherwise nanoseconds
+    static const char* clockUnit();
+    static uint64_t now() {
+#if defined(__x86_64__) || defined(__i386__)
+        return __rdtsc();
+#else
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(
+                    std::chrono::steady_clock::now().time_since_epoch()).count();
+#endif
+    }
+
+    // record the start of an opcode; the time since the previous opcode
+    // started is charged to the previous opcode
+    void step(int opcode) {
+        uint64_t time = now();
+        if (lastOpcode >= 0) {
+            cycles[lastOpcode] += time - lastTime;
+            ++pairs[lastOpcode * OPCODE_COUNT + opcode];
+        }
+        ++counts[opcode];
+        lastOpcode = opcode;
+        lastTime = time;
+    }
+    // the VM stopped running; charge the time to the last opcode run so time
+    // spent outside the VM (such as waiting for input) is not counted
+    void stop() {
+        if (lastOpcode >= 0) {
+            cycles[lastOpcode] += now() - lastTime;
+        }
+        lastOpcode = -1;
+    }
+
+    void writeTable(std::ostream &out, unsigned maxPairs = 20) const;
+    bool writeJSON(const std::string &filename) const;
+
+private:
+    std::vector<uint64_t> counts;
+    std::vector<uint64_t> cycles;
+    std::vector<uint64_t> pairs;    // indexed by first * OPCODE_COUNT + second
+    int lastOpcode;
+    uint64_t lastTime;
+};
+
+struct GameData;
+class gtCallStack;
+
+// the name of a function in the game's source, or its id if it has none
+std::string functionName(const GameData &gamedata, int functionId);
+
+// Instructions executed, time taken, and items allocated by each function,
+// kept separately for every distinct chain of calls that reached it. Only
+// collected when the runner is started with -profile-functions.
+class FunctionProfile {
+public:
+    FunctionProfile();
+
+    // the VM started running; match the profile to the current call stack
+    void start(const gtCallStack &callStack, long instructionCount);
+    // the VM stopped running
+    void stop(long instructionCount);
+    void enter(int functionId, bool isTailCall, long instructionCount);
+    void leave(long instructionCount);
+    void allocation() {
+        ++nodes[current].allocations;
+    }
+
+    void writeTable(std::ostream &out, const GameData &gamedata) const;
+    // write one line per call chain in the collapsed stack format used by
+    // flame graph tools, weighted by the instructions run by the last
+    // function in the chain
+    bool writeCollapsed(const std::string &filename, const GameData &gamedata) const;
+
+private:
+    struct Node {
+        Node(int functionId, int parent)
+        : functionId(functionId), parent(parent),
+          calls(0), instructions(0), time(0), allocations(0)
+        { }
+        int functionId;
+        int parent;
+        std::map<int, int> children;    // function id -> node index
+        uint64_t calls;
+        uint64_t instructions;
+        uint64_t time;
+        uint64_t allocations;
+    };
+
+    static uint64_t now();
+    int child(int parent, int functionId);
+    void charge(long instructionCount);
+    template<class Visitor>
+    void walk(Visitor visit) const;
+
+    // nodes[0] is the root that every call chain starts from; a node always
+    // comes after its parent
+    std::vector<Node> nodes;
+    int current;
+    long lastCount;
+    uint64_t lastTime;
+};
+
+// The function calls in progress, sampled every millisecond of processor
+// time. Only collected when the runner is started with -sample. This costs
+// far less than the other profilers, so it can be left running through long
+// sessions.
+class SampleProfile {
+public:
+    static const int MAX_DEPTH = 64;        // innermost frames kept per sample
+    static const int BUFFER_SIZE = 1024;    // samples held before being tallied
+    static const int INTERVAL_USEC = 1000;
+    // where there's no profiling timer, sample after this many checks instead
+    static const unsigned long INTERVAL_CHECKS = 10000;
+
+    SampleProfile();
+    ~SampleProfile();
+
+    // the timer only asks for a sample since the call stack can't safely be
+    // read from a signal handler; the VM checks for one at each jump, call,
+    // and return
+    bool isDue() {
+#if defined(__linux__) || (defined(__APPLE__) && defined(__MACH__))
+        return sampleDue.load(std::memory_order_relaxed);
+#else
+        return ++checks % INTERVAL_CHECKS == 0;
+#endif
+    }
+    static void requestSample() {
+        sampleDue.store(true, std::memory_order_relaxed);
+    }
+    static void clearDue() {
+        sampleDue.store(false, std::memory_order_relaxed);
+    }
+    void take(const gtCallStack &callStack, unsigned IP);
+
+    void writeTable(std::ostream &out, const GameData &gamedata, unsigned maxSpots = 20);
+    // write the sampled call stacks in the collapsed stack format used by
+    // flame graph tools
+    bool writeCollapsed(const std::string &filename, const GameData &gamedata);
+
+private:
+    struct Frame {
+        int functionId;
+        unsigned offset;    // from the start of the function
+    };
+    struct Sample {
+        int depth;
+        bool truncated;
+        Frame frames[MAX_DEPTH];    // innermost first
+    };
+
+    void tally();
+
+    static std::atomic<bool> sampleDue;
+    std::vector<Sample> buffer;
+    unsigned bufferCount;
+    unsigned long checks;
+    uint64_t sampleCount;
+    // function ids of each sampled call stack, outermost first; stacks
+    // deeper than MAX_DEPTH start with -1
+    std::map<std::vector<int>, uint64_t> stacks;
+    // samples at each function and offset that was running
+    std::map<std::pair<int, unsigned>, uint64_t> spots;
+};
+
+#endif
@@ -0,0 +1,75 @@
+#ifndef RANDOM_H
+#define RANDOM_H
+
+#include <array>
+#include <cstdint>
+
+// The xoshiro128** pseudo-random number generator. Each game has its own, so
+// games running at the same time never affect one another's numbers and the
+// same seed always gives the same numbers.
+class RandomGenerator {
+public:
+    RandomGenerator() {
+        seed(0);
+    }
+
+    // similar seeds still give unrelated numbers since the seed is expanded
+    // into the full state with splitmix64
+    void seed(uint64_t value) {
+        for (int i = 0; i < 4; i += 2) {
+            value += 0x9E3779B97F4A7C15ULL;
+            uint64_t z = value;
+            z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+            z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+            z ^= z >> 31;
+            state[i] = static_cast<uint32_t>(z);
+            state[i + 1] = static_cast<uint32_t>(z >> 32);
+        }
+    }
+
+    uint32_t next() {
+        const uint32_t result = rotate(state[1] * 5, 7) * 9;
+        const uint32_t t = state[1] << 9;
+        state[2] ^= state[0];
+        state[3] ^= state[1];
+        state[1] ^= state[2];
+        state[0] ^= state[3];
+        state[2] ^= t;
+        state[3] = rotate(state[3], 11);
+        return result;
+    }
+    uint64_t next64() {
+        uint64_t high = next();
+        return (high << 32) | next();
+    }
+
+    // a number from zero up to, but not including, bound with every number
+    // equally likely; numbers that would favour the low end of the range
+    // are rejected and drawn again
+    uint32_t below(uint32_t bound) {
+        uint64_t product = static_cast<uint64_t>(next()) * bound;
+        uint32_t low = static_cast<uint32_t>(product);
+        if (low < bound) {
+            const uint32_t threshold = -bound % bound;
+            while (low < threshold) {
+                product = static_cast<uint64_t>(next()) * bound;
+                low = static_cast<uint32_t>(product);
+            }
+        }
+        return static_cast<uint32_t>(product >> 32);
+    }
+
+    // the generator never reaches this state, so it marks a corrupt one
+    bool isValid() const {
+        return state[0] || state[1] || state[2] || state[3];
+    }
+
+    std::array<uint32_t, 4> state;
+
+private:
+    static uint32_t rotate(uint32_t value, int bits) {
+        return (value << bits) | (value >> (32 - bits));
+    }
+};
+
+#endif
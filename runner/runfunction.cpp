@@ -1,4 +1,5 @@
 #include <cctype>
+#include <climits>
 #include <cstdlib>
 #include <iostream>
 #include <iomanip>
@@ -6,26 +7,200 @@
 #include <string>
 #include "gamedata.h"
 #include "opcode.h"
+#include "probe.h"
+#include "profile.h"
 #include "textutil.h"
 #include "stack.h"
+#include "trace.h"
+
+// Apply a binary operator to two values, where rhs was pushed after lhs.
+// This is shared by the stack and register forms of each operator.
+static Value binaryOperation(int opcode, const Value &lhs, const Value &rhs) {
+    switch(opcode) {
+        case OpcodeDef::Equal:
+            return Value{Value::Integer, !lhs.compare(rhs)};
+        case OpcodeDef::NotEqual:
+            return Value{Value::Integer, lhs.compare(rhs)};
+        case OpcodeDef::LessThan:
+            return Value{Value::Integer, lhs.compare(rhs) > 0};
+        case OpcodeDef::LessThanEqual:
+            return Value{Value::Integer, lhs.compare(rhs) >= 0};
+        case OpcodeDef::GreaterThan:
+            return Value{Value::Integer, lhs.compare(rhs) < 0};
+        case OpcodeDef::GreaterThanEqual:
+            return Value{Value::Integer, lhs.compare(rhs) <= 0};
+
+        case OpcodeDef::Add:
+            lhs.requireType(Value::Integer);
+            rhs.requireType(Value::Integer);
+            return Value{Value::Integer, rhs.value + lhs.value};
+        case OpcodeDef::Sub:
+            lhs.requireType(Value::Integer);
+            rhs.requireType(Value::Integer);
+            return Value{Value::Integer, rhs.value - lhs.value};
+        case OpcodeDef::Mult:
+            lhs.requireType(Value::Integer);
+            rhs.requireType(Value::Integer);
+            return Value{Value::Integer, rhs.value * lhs.value};
+        case OpcodeDef::Div:
+            lhs.requireType(Value::Integer);
+            rhs.requireType(Value::Integer);
+            return Value{Value::Integer, rhs.value / lhs.value};
+        case OpcodeDef::Mod:
+            lhs.requireType(Value::Integer);
+            rhs.requireType(Value::Integer);
+            return Value{Value::Integer, rhs.value % lhs.value};
+        case OpcodeDef::Pow: {
+            rhs.requireType(Value::Integer);
+            lhs.requireType(Value::Integer);
+            int result = 1;
+            for (int i = 0; i < lhs.value; ++i) result *= rhs.value;
+            return Value{Value::Integer, result}; }
+        case OpcodeDef::BitLeft:
+            rhs.requireType(Value::Integer);
+            lhs.requireType(Value::Integer);
+            return Value(Value::Integer, rhs.value << lhs.value);
+        case OpcodeDef::BitRight:
+            rhs.requireType(Value::Integer);
+            lhs.requireType(Value::Integer);
+            return Value(Value::Integer, rhs.value >> lhs.value);
+        case OpcodeDef::BitAnd:
+            rhs.requireType(Value::Integer);
+            lhs.requireType(Value::Integer);
+            return Value(Value::Integer, rhs.value & lhs.value);
+        case OpcodeDef::BitOr:
+            rhs.requireType(Value::Integer);
+            lhs.requireType(Value::Integer);
+            return Value(Value::Integer, rhs.value | lhs.value);
+        case OpcodeDef::BitXor:
+            rhs.requireType(Value::Integer);
+            lhs.requireType(Value::Integer);
+            return Value(Value::Integer, rhs.value ^ lhs.value);
+    }
+
+    std::stringstream ss;
+    ss << "Opcode " << opcode << " is not a binary operation.";
+    throw GameError(ss.str());
+}
+
+// Read an operand of register_op and get its value.
+Value GameData::readOperand(unsigned &IP) {
+    int kind = image->bytecode.read_8(IP);
+    ++IP;
+    switch(kind) {
+        case REGISTER_STACK:
+            return callStack.pop();
+        case REGISTER_LOCAL: {
+            int local = image->bytecode.read_8(IP);
+            ++IP;
+            return callStack.getStack().getArg(local); }
+        case REGISTER_CONSTANT: {
+            int type = image->bytecode.read_8(IP);
+            ++IP;
+            int value = image->bytecode.read_32(IP);
+            IP += 4;
+            return Value(static_cast<Value::Type>(type), value); }
+    }
+    throw GameError("Invalid register_op operand.");
+}
+
+void GameData::checkArgumentTypes(const FunctionDef &function, const std::vector<Value> &args) const {
+    for (int i = 0; i < static_cast<int>(args.size()); ++i) {
+        if (function.argTypes[i] != Value::Any && args[i].type != function.argTypes[i]) {
+            const std::string &name = getString(function.srcName).text;
+            std::stringstream ss;
+            ss << "Function " << name << " expected argument ";
+            ss << i << " to be " <<  function.argTypes[i];
+            ss << " but received " << args[i].type;
+            throw GameError(ss.str());
+        }
+    }
+}
 
 Value GameData::resume(bool pushValue, const Value &inValue) {
+    if (opcodeProfile || functionProfile || sampleProfile || trackAllocations) {
+        return execute<true>(pushValue, inValue);
+    }
+    return execute<false>(pushValue, inValue);
+}
+
+// Starts the profilers when the VM starts running and stops them however it
+// stops, including by an error.
+struct ProfileScope {
+    explicit ProfileScope(GameData *gamedata) : gamedata(gamedata) {
+        if (!gamedata) return;
+        if (gamedata->functionProfile) {
+            gamedata->functionProfile->start(gamedata->callStack, gamedata->instructionCount);
+        }
+        // a sample asked for while the VM wasn't running would be charged
+        // to whatever runs first
+        if (gamedata->sampleProfile) SampleProfile::clearDue();
+    }
+    ~ProfileScope() {
+        if (!gamedata) return;
+        if (gamedata->opcodeProfile) gamedata->opcodeProfile->stop();
+        if (gamedata->functionProfile) {
+            gamedata->functionProfile->stop(gamedata->instructionCount);
+        }
+    }
+    GameData *gamedata;
+};
+
+#ifdef RATVM_PROBES
+// Marks a span for each time the VM runs. The calls in progress are closed
+// when the VM stops and opened again when it resumes so they nest inside the
+// span rather than staying open while the game waits for input.
+struct ProbeRunScope {
+    explicit ProbeRunScope(const gtCallStack &callStack) : callStack(callStack) {
+        PROBE_BEGIN("run", 0);
+        for (int i = 0; i < callStack.size(); ++i) PROBE_CALL(callStack[i].functionId);
+    }
+    ~ProbeRunScope() {
+        for (int i = 0; i < callStack.size(); ++i) PROBE_RETURN();
+        PROBE_END("run");
+    }
+    const gtCallStack &callStack;
+};
+#endif
+
+// Take a sample of the call stack if one is due. This is only checked on
+// opcodes that change which code is running, which is often enough to never
+// leave a sample waiting for long and much cheaper than checking every opcode.
+static void sampleIfDue(GameData &gamedata, unsigned IP) {
+    if (gamedata.sampleProfile && gamedata.sampleProfile->isDue()) {
+        gamedata.sampleProfile->take(gamedata.callStack, IP);
+    }
+}
+
+// The VM itself. It is compiled once with profiling and once without so the
+// usual case pays nothing for the profilers or for tracking allocations.
+template<bool profiled>
+Value GameData::execute(bool pushValue, const Value &inValue) {
+    ProfileScope profileScope(profiled ? this : nullptr);
+#ifdef RATVM_PROBES
+    ProbeRunScope probeRunScope(callStack);
+#endif
     if (pushValue) callStack.push(inValue);
     unsigned IP = callStack.callTop().IP;
 
     while (1) {
         ++instructionCount;
 
-        int opcode = bytecode.read_8(IP);
+        int opcode = image->bytecode.read_8(IP);
         ++IP;
+        if (profiled && opcodeProfile) opcodeProfile->step(opcode);
+        if (profiled && trackAllocations) allocationIP = IP - 1;
 
         switch(opcode) {
             case OpcodeDef::Return: {
+                if (profiled) sampleIfDue(*this, IP - 1);
                 Value retValue = noneValue;
                 if (!callStack.getStack().isEmpty()) {
                     retValue = callStack.pop();
                 }
                 callStack.drop();
+                PROBE_RETURN();
+                if (profiled && functionProfile) functionProfile->leave(instructionCount);
                 if (callStack.isEmpty()) {
                     optionType = OptionType::EndOfProgram;
                     return retValue;
@@ -36,12 +211,12 @@ Value GameData::resume(bool pushValue, const Value &inValue) {
                 break; }
 
             case OpcodeDef::Push0: {
-                int type = bytecode.read_8(IP);
+                int type = image->bytecode.read_8(IP);
                 ++IP;
                 callStack.push(Value(static_cast<Value::Type>(type), 0));
                 break; }
             case OpcodeDef::Push1: {
-                int type = bytecode.read_8(IP);
+                int type = image->bytecode.read_8(IP);
                 ++IP;
                 callStack.push(Value(static_cast<Value::Type>(type), 1));
                 break; }
@@ -49,25 +224,25 @@ Value GameData::resume(bool pushValue, const Value &inValue) {
                 callStack.push(noneValue);
                 break; }
             case OpcodeDef::Push8: {
-                int type = bytecode.read_8(IP);
+                int type = image->bytecode.read_8(IP);
                 ++IP;
-                int value = bytecode.read_8(IP);
+                int value = image->bytecode.read_8(IP);
                 ++IP;
                 if (value & 0x80) value |= 0xFFFFFF00;
                 callStack.push(Value(static_cast<Value::Type>(type), value));
                 break; }
             case OpcodeDef::Push16: {
-                int type = bytecode.read_8(IP);
+                int type = image->bytecode.read_8(IP);
                 ++IP;
-                int value = bytecode.read_16(IP);
+                int value = image->bytecode.read_16(IP);
                 IP += 2;
                 if (value & 0x8000) value |= 0xFFFF0000;
                 callStack.push(Value(static_cast<Value::Type>(type), value));
                 break; }
             case OpcodeDef::Push32: {
-                int type = bytecode.read_8(IP);
+                int type = image->bytecode.read_8(IP);
                 ++IP;
-                int value = bytecode.read_32(IP);
+                int value = image->bytecode.read_32(IP);
                 IP += 4;
                 callStack.push(Value(static_cast<Value::Type>(type), value));
                 break; }
@@ -85,6 +260,13 @@ Value GameData::resume(bool pushValue, const Value &inValue) {
             case OpcodeDef::CollectGarbage: {
                 callStack.push(Value(Value::Integer, collectGarbage()));
                 break; }
+            case OpcodeDef::HeapStat: {
+                Value statistic = callStack.pop();
+                statistic.requireType(Value::Integer);
+                unsigned long long result = heapStats.get(statistic.value);
+                if (result > INT_MAX) result = INT_MAX;
+                callStack.push(Value(Value::Integer, static_cast<int>(result)));
+                break; }
 
             case OpcodeDef::SayUCFirst: {
                 Value theText = callStack.pop();
@@ -125,7 +307,9 @@ Value GameData::resume(bool pushValue, const Value &inValue) {
                 callStack.push(Value(Value::Integer, callStack.getStack().size()));
                 break; }
 
-            case OpcodeDef::Call: {
+            case OpcodeDef::Call:
+            case OpcodeDef::TailCall: {
+                if (profiled) sampleIfDue(*this, IP - 1);
                 Value functionId = callStack.pop();
                 Value argCount = callStack.pop();
                 functionId.requireType(Value::Function);
@@ -140,22 +324,63 @@ Value GameData::resume(bool pushValue, const Value &inValue) {
                     funcArgs.push_back(callStack.pop());
                 }
 
-                callStack.callTop().IP = IP;
-                const FunctionDef &newFunc = functions[functionId.value];
+                const FunctionDef &newFunc = getFunction(functionId.value);
+                // a tail call replaces the current frame instead of
+                // returning to it
+                if (opcode == OpcodeDef::TailCall) {
+                    callStack.drop();
+                    PROBE_RETURN();
+                } else {
+                    callStack.callTop().IP = IP;
+                }
                 callStack.create(newFunc, functionId.value);
+                PROBE_CALL(functionId.value);
+                if (profiled && functionProfile) {
+                    functionProfile->enter(functionId.value,
+                                           opcode == OpcodeDef::TailCall,
+                                           instructionCount);
+                }
                 callStack.getStack().setArgs(funcArgs,
                         callStack.callTop().funcDef.arg_count,
                         callStack.callTop().funcDef.local_count);
-                const auto &args = callStack.getStack().argList;
-                for (int i = 0; i < static_cast<int>(args.size()); ++i) {
-                    if (newFunc.argTypes[i] != Value::Any && args[i].type != newFunc.argTypes[i]) {
-                        const std::string &name = getString(newFunc.srcName).text;
-                        std::stringstream ss;
-                        ss << "Function " << name << " expected argument ";
-                        ss << i << " to be " <<  newFunc.argTypes[i];
-                        ss << " but received " << args[i].type;
-                        throw GameError(ss.str());
-                    }
+                checkArgumentTypes(newFunc, callStack.getStack().argList);
+                IP = newFunc.position;
+                break; }
+            case OpcodeDef::CallDirect:
+            case OpcodeDef::TailCallDirect: {
+                if (profiled) sampleIfDue(*this, IP - 1);
+                int functionId = image->bytecode.read_32(IP);
+                IP += 4;
+                int argCount = image->bytecode.read_8(IP);
+                ++IP;
+                bool checkTypes = image->bytecode.read_8(IP);
+                ++IP;
+                const FunctionDef &newFunc = getFunction(functionId);
+                std::vector<Value> args;
+                args.reserve(newFunc.arg_count + newFunc.local_count);
+                args.push_back(noneValue);
+                for (int i = 0; i < argCount; ++i) {
+                    args.push_back(callStack.pop());
+                }
+                args.resize(newFunc.arg_count);
+                args.resize(newFunc.arg_count + newFunc.local_count);
+
+                if (opcode == OpcodeDef::TailCallDirect) {
+                    callStack.drop();
+                    PROBE_RETURN();
+                } else {
+                    callStack.callTop().IP = IP;
+                }
+                callStack.create(newFunc, functionId);
+                PROBE_CALL(functionId);
+                if (profiled && functionProfile) {
+                    functionProfile->enter(functionId,
+                                           opcode == OpcodeDef::TailCallDirect,
+                                           instructionCount);
+                }
+                callStack.getStack().argList.swap(args);
+                if (checkTypes) {
+                    checkArgumentTypes(newFunc, callStack.getStack().argList);
                 }
                 IP = newFunc.position;
                 break; }
@@ -169,13 +394,13 @@ Value GameData::resume(bool pushValue, const Value &inValue) {
                 Value listId = callStack.pop();
                 Value value = callStack.pop();
                 listId.requireType(Value::List);
-                ListDef &list = getList(listId.value);
+                ListDef &list = getMutableList(listId.value);
                 list.items.push_back(value);
                 break; }
             case OpcodeDef::ListPop: {
                 Value listId = callStack.pop();
                 listId.requireType(Value::List);
-                ListDef &list = getList(listId.value);
+                ListDef &list = getMutableList(listId.value);
                 Value value = list.items.back();
                 list.items.pop_back();
                 callStack.push(value);
@@ -246,14 +471,14 @@ Value GameData::resume(bool pushValue, const Value &inValue) {
                 switch(from.type) {
                     case Value::Object:
                         index.requireType(Value::Property);
-                        getObject(from.value).set(index.value, toValue);
+                        getMutableObject(from.value).set(index.value, toValue);
                         break;
                     case Value::List:
                         index.requireType(Value::Integer);
-                        getList(from.value).set(index.value, toValue);
+                        getMutableList(from.value).set(index.value, toValue);
                         break;
                     case Value::Map: {
-                        MapDef &mapDef = getMap(from.value);
+                        MapDef &mapDef = getMutableMap(from.value);
                         mapDef.set(index, toValue);
                         break; }
                     default:
@@ -270,10 +495,10 @@ Value GameData::resume(bool pushValue, const Value &inValue) {
                 target.requireType(Value::List, Value::Map);
                 if (target.type == Value::List) {
                     index.requireType(Value::Integer);
-                    ListDef &listDef = getList(target.value);
+                    ListDef &listDef = getMutableList(target.value);
                     listDef.del(index.value);
                 } else if (target.type == Value::Map) {
-                    MapDef &mapDef = getMap(target.value);
+                    MapDef &mapDef = getMutableMap(target.value);
                     mapDef.del(index);
                 } else {
                     throw GameError("not implemented");
@@ -286,7 +511,7 @@ Value GameData::resume(bool pushValue, const Value &inValue) {
                 theList.requireType(Value::List);
                 theIndex.requireType(Value::Integer);
                 theValue.forbidType(Value::VarRef);
-                ListDef &listDef = getList(theList.value);
+                ListDef &listDef = getMutableList(theList.value);
                 if (theIndex.value < 0) theIndex.value = 0;
                 if (theIndex.value > static_cast<int>(listDef.items.size())) {
                     theIndex.value = static_cast<int>(listDef.items.size());
@@ -301,24 +526,69 @@ Value GameData::resume(bool pushValue, const Value &inValue) {
                 callStack.push(Value{static_cast<Value::Type>(toType.value), ofWhat.value});
                 break; }
 
-            case OpcodeDef::Equal: {
+            case OpcodeDef::Equal:
+            case OpcodeDef::NotEqual:
+            case OpcodeDef::LessThan:
+            case OpcodeDef::LessThanEqual:
+            case OpcodeDef::GreaterThan:
+            case OpcodeDef::GreaterThanEqual:
+            case OpcodeDef::Add:
+            case OpcodeDef::Sub:
+            case OpcodeDef::Mult:
+            case OpcodeDef::Div:
+            case OpcodeDef::Mod:
+            case OpcodeDef::Pow:
+            case OpcodeDef::BitLeft:
+            case OpcodeDef::BitRight:
+            case OpcodeDef::BitAnd:
+            case OpcodeDef::BitOr:
+            case OpcodeDef::BitXor: {
                 Value rhs = callStack.pop();
                 Value lhs = callStack.pop();
-                callStack.push(Value{Value::Integer, !lhs.compare(rhs)});
+                callStack.push(binaryOperation(opcode, lhs, rhs));
                 break; }
-            case OpcodeDef::NotEqual: {
-                Value rhs = callStack.pop();
-                Value lhs = callStack.pop();
-                callStack.push(Value{Value::Integer, lhs.compare(rhs)});
+            case OpcodeDef::RegisterOp: {
+                int operation = image->bytecode.read_8(IP);
+                ++IP;
+                int resultKind = image->bytecode.read_8(IP);
+                ++IP;
+                unsigned resultTo = 0;
+                if (resultKind == REGISTER_LOCAL) {
+                    resultTo = image->bytecode.read_8(IP);
+                    ++IP;
+                } else if (resultKind != REGISTER_STACK) {
+                    resultTo = image->bytecode.read_32(IP);
+                    IP += 4;
+                }
+                Value rhs = readOperand(IP);
+                Value lhs = readOperand(IP);
+                Value result = binaryOperation(operation, lhs, rhs);
+                switch(resultKind) {
+                    case REGISTER_STACK:
+                        callStack.push(result);
+                        break;
+                    case REGISTER_LOCAL:
+                        callStack.getStack().setArg(resultTo, result);
+                        break;
+                    case REGISTER_JUMP_ZERO:
+                        if (!result.isTrue()) IP = callStack.callTop().funcDef.position + resultTo;
+                        break;
+                    case REGISTER_JUMP_NOT_ZERO:
+                        if (result.isTrue()) IP = callStack.callTop().funcDef.position + resultTo;
+                        break;
+                    default:
+                        throw GameError("Invalid register_op result.");
+                }
                 break; }
 
-
             case OpcodeDef::Jump: {
+                if (profiled) sampleIfDue(*this, IP - 1);
                 Value target = callStack.pop();
                 target.requireType(Value::JumpTarget);
                 IP = callStack.callTop().funcDef.position + target.value;
                 break; }
             case OpcodeDef::JumpZero: {
+                if (profiled) sampleIfDue(*this, IP - 1);
                 Value target = callStack.pop();
                 Value condition = callStack.pop();
                 target.requireType(Value::JumpTarget);
@@ -327,6 +597,7 @@ Value GameData::resume(bool pushValue, const Value &inValue) {
                 }
                 break; }
             case OpcodeDef::JumpNotZero: {
+                if (profiled) sampleIfDue(*this, IP - 1);
                 Value target = callStack.pop();
                 Value condition = callStack.pop();
                 target.requireType(Value::JumpTarget);
@@ -334,111 +605,11 @@ Value GameData::resume(bool pushValue, const Value &inValue) {
                     IP = callStack.callTop().funcDef.position + target.value;
                 }
                 break; }
-            case OpcodeDef::LessThan: {
-                Value rhs = callStack.pop();
-                Value lhs = callStack.pop();
-                callStack.push(Value{Value::Integer, lhs.compare(rhs) > 0});
-                break; }
-            case OpcodeDef::LessThanEqual: {
-                Value rhs = callStack.pop();
-                Value lhs = callStack.pop();
-                callStack.push(Value{Value::Integer, lhs.compare(rhs) >= 0});
-                break; }
-            case OpcodeDef::GreaterThan: {
-                Value rhs = callStack.pop();
-                Value lhs = callStack.pop();
-                callStack.push(Value{Value::Integer, lhs.compare(rhs) < 0});
-                break; }
-            case OpcodeDef::GreaterThanEqual: {
-                Value rhs = callStack.pop();
-                Value lhs = callStack.pop();
-                callStack.push(Value{Value::Integer, lhs.compare(rhs) <= 0});
-                break; }
-
             case OpcodeDef::Not: {
                 Value v = callStack.pop();
                 if (v.isTrue()) callStack.push(Value(Value::Integer, 0));
                 else            callStack.push(Value(Value::Integer, 1));
                 break; }
-            case OpcodeDef::Add: {
-                Value rhs = callStack.pop();
-                Value lhs = callStack.pop();
-                lhs.requireType(Value::Integer);
-                rhs.requireType(Value::Integer);
-                callStack.push(Value{Value::Integer, rhs.value + lhs.value});
-                break; }
-            case OpcodeDef::Sub: {
-                Value rhs = callStack.pop();
-                Value lhs = callStack.pop();
-                lhs.requireType(Value::Integer);
-                rhs.requireType(Value::Integer);
-                callStack.push(Value{Value::Integer, rhs.value - lhs.value});
-                break; }
-            case OpcodeDef::Mult: {
-                Value rhs = callStack.pop();
-                Value lhs = callStack.pop();
-                lhs.requireType(Value::Integer);
-                rhs.requireType(Value::Integer);
-                callStack.push(Value{Value::Integer, rhs.value * lhs.value});
-                break; }
-            case OpcodeDef::Div: {
-                Value rhs = callStack.pop();
-                Value lhs = callStack.pop();
-                lhs.requireType(Value::Integer);
-                rhs.requireType(Value::Integer);
-                callStack.push(Value{Value::Integer, rhs.value / lhs.value});
-                break; }
-            case OpcodeDef::Mod: {
-                Value rhs = callStack.pop();
-                Value lhs = callStack.pop();
-                lhs.requireType(Value::Integer);
-                rhs.requireType(Value::Integer);
-                callStack.push(Value{Value::Integer, rhs.value % lhs.value});
-                break; }
-            case OpcodeDef::Pow: {
-                Value lhs = callStack.pop();
-                Value rhs = callStack.pop();
-                lhs.requireType(Value::Integer);
-                rhs.requireType(Value::Integer);
-                int result = 1;
-                for (int i = 0; i < rhs.value; ++i) result *= lhs.value;
-                callStack.push(Value{Value::Integer, result});
-                break; }
-            case OpcodeDef::BitLeft: {
-                Value v1 = callStack.pop();
-                Value v2 = callStack.pop();
-                v1.requireType(Value::Integer);
-                v2.requireType(Value::Integer);
-                callStack.push(Value(Value::Integer, v1.value << v2.value));
-                break; }
-            case OpcodeDef::BitRight: {
-                Value v1 = callStack.pop();
-                Value v2 = callStack.pop();
-                v1.requireType(Value::Integer);
-                v2.requireType(Value::Integer);
-                callStack.push(Value(Value::Integer, v1.value >> v2.value));
-                break; }
-            case OpcodeDef::BitAnd: {
-                Value v1 = callStack.pop();
-                Value v2 = callStack.pop();
-                v1.requireType(Value::Integer);
-                v2.requireType(Value::Integer);
-                callStack.push(Value(Value::Integer, v1.value & v2.value));
-                break; }
-            case OpcodeDef::BitOr: {
-                Value v1 = callStack.pop();
-                Value v2 = callStack.pop();
-                v1.requireType(Value::Integer);
-                v2.requireType(Value::Integer);
-                callStack.push(Value(Value::Integer, v1.value | v2.value));
-                break; }
-            case OpcodeDef::BitXor: {
-                Value v1 = callStack.pop();
-                Value v2 = callStack.pop();
-                v1.requireType(Value::Integer);
-                v2.requireType(Value::Integer);
-                callStack.push(Value(Value::Integer, v1.value ^ v2.value));
-                break; }
             case OpcodeDef::BitNot: {
                 Value v = callStack.pop();
                 v.requireType(Value::Integer);
@@ -450,7 +621,7 @@ Value GameData::resume(bool pushValue, const Value &inValue) {
                 min.requireType(Value::Integer);
                 max.requireType(Value::Integer);
                 if (min.value == max.value) {
-                    return min;
+                    callStack.push(min);
                 } else {
                     int maxv = max.value, minv = min.value;
                     if (maxv < minv) {
@@ -458,13 +629,15 @@ Value GameData::resume(bool pushValue, const Value &inValue) {
                         maxv = minv;
                         minv = t;
                     }
-                    int result = minv + rand() % (maxv - minv);
-                    callStack.push(Value{Value::Integer, result});
+                    // in unsigned arithmetic so ranges wider than INT_MAX work
+                    uint32_t range = static_cast<uint32_t>(maxv) - static_cast<uint32_t>(minv);
+                    uint32_t result = static_cast<uint32_t>(minv) + random.below(range);
+                    callStack.push(Value{Value::Integer, static_cast<int>(result)});
                 }
                 break; }
             case OpcodeDef::NextObject: {
                 Value lastValue = callStack.pop();
-                if (objects.empty()) {
+                if (nextObject <= 1) {
                     callStack.push(noneValue);
                 } else {
                     int nextValue = 0;
@@ -475,7 +648,7 @@ Value GameData::resume(bool pushValue, const Value &inValue) {
 
                     while (1) {
                         ++nextValue;
-                        if (nextValue >= static_cast<int>(objects.size())) {
+                        if (nextValue >= static_cast<int>(nextObject)) {
                             callStack.push(noneValue);
                             break;
                         }
@@ -510,7 +683,7 @@ Value GameData::resume(bool pushValue, const Value &inValue) {
                 if (listDef.items.size() == 0) {
                     callStack.push(Value(Value::Integer, 0));
                 } else {
-                    std::vector<Value>::size_type choice = rand() % listDef.items.size();
+                    uint32_t choice = random.below(listDef.items.size());
                     callStack.push(listDef.items[choice]);
                 }
                 break; }
@@ -519,7 +692,7 @@ Value GameData::resume(bool pushValue, const Value &inValue) {
                 theMap.requireType(Value::Map);
                 const MapDef &mapDef = getMap(theMap.value);
                 Value theList = makeNew(Value::List);
-                ListDef &listDef = getList(theList.value);
+                ListDef &listDef = getMutableList(theList.value);
                 for (const MapDef::Row &row : mapDef.rows) {
                     listDef.items.push_back(row.key);
                 }
@@ -598,7 +771,7 @@ Value GameData::resume(bool pushValue, const Value &inValue) {
             case OpcodeDef::StringClear: {
                 Value theString = callStack.pop();
                 theString.requireType(Value::String);
-                StringDef &strDef = getString(theString.value);
+                StringDef &strDef = getMutableString(theString.value);
                 strDef.text.clear();
                 break; }
             case OpcodeDef::StringAppend: {
@@ -650,7 +823,7 @@ Value GameData::resume(bool pushValue, const Value &inValue) {
                 std::string str = getString(stringId.value).text;
                 Value listId = makeNew(Value::List);
                 callStack.push(listId);
-                ListDef &list = getList(listId.value);
+                ListDef &list = getMutableList(listId.value);
 
                 unsigned v = 0;
                 int counter = 0;
@@ -693,7 +866,7 @@ Value GameData::resume(bool pushValue, const Value &inValue) {
                     result += static_cast<char>(v1);
                 }
                 Value stringId = makeNew(Value::String);
-                getString(stringId.value).text = result;
+                getMutableString(stringId.value).text = result;
 
                 callStack.push(stringId);
                 break; }
@@ -707,14 +880,16 @@ Value GameData::resume(bool pushValue, const Value &inValue) {
                     forGameId = getString(gameIdRef.value).text;
                     myGameId = getString(refGameid).text;
                 }
-                FileList filelist = getFileList();
+                FileList filelist;
+                if (!trace || !trace->isReplaying()) filelist = getFileList();
+                if (trace) trace->fileList(filelist);
                 Value listId = makeNew(Value::List);
-                ListDef &list = getList(listId.value);
+                ListDef &list = getMutableList(listId.value);
                 callStack.push(listId);
                 for (auto record : filelist) {
                     if (forGameId != myGameId) continue;
                     Value rowId = makeNew(Value::List);
-                    ListDef &row = getList(rowId.value);
+                    ListDef &row = getMutableList(rowId.value);
                     row.items.push_back(makeNewString(record.name));
                     std::time_t recordDate = record.date;
                     std::string timeString = trim(ctime(&recordDate));
@@ -755,9 +930,9 @@ Value GameData::resume(bool pushValue, const Value &inValue) {
                 text.requireType(Value::String);
                 strList.requireType(Value::List, Value::None);
                 vocabList.requireType(Value::List, Value::None);
-                ListDef *strListDef = strList.type == Value::None ? nullptr : &getList(strList.value);
+                ListDef *strListDef = strList.type == Value::None ? nullptr : &getMutableList(strList.value);
                 if (strListDef) strListDef->items.clear();
-                ListDef *vocabListDef = vocabList.type == Value::None ? nullptr : &getList(vocabList.value);
+                ListDef *vocabListDef = vocabList.type == Value::None ? nullptr : &getMutableList(vocabList.value);
                 if (vocabListDef) vocabListDef->items.clear();
 
                 auto result = explodeString(getString(text.value).text);
@@ -822,7 +997,7 @@ Value GameData::resume(bool pushValue, const Value &inValue) {
                 callStack.push(childList);
                 const ObjectDef &object = getObject(objectId.value);
                 if (object.childId != 0) {
-                    ListDef &list = getList(childList.value);
+                    ListDef &list = getMutableList(childList.value);
                     const ObjectDef *child = &getObject(object.childId);
                     while (1) {
                         list.items.push_back(Value{Value::Object, static_cast<int>(child->ident)});
@@ -1,14 +1,77 @@
+#include <chrono>
+#include <fstream>
 #include <iostream>
+#include <memory>
+#include <random>
 #include <string>
+#include <thread>
 #include <string.h>
+#include <stdlib.h>
 #include "gamedata.h"
 #include "io.h"
+#include "probe.h"
+#include "profile.h"
+#include "trace.h"
+
+static void reportProfiles(const GameData &data, const std::string &opcodeFile,
+                           const std::string &functionFile, const std::string &sampleFile) {
+    if (data.opcodeProfile) {
+        std::cerr << '\n';
+        data.opcodeProfile->writeTable(std::cerr);
+        if (!data.opcodeProfile->writeJSON(opcodeFile)) {
+            std::cerr << "Failed to write profile to " << opcodeFile << ".\n";
+        }
+    }
+    if (data.functionProfile) {
+        std::cerr << '\n';
+        data.functionProfile->writeTable(std::cerr, data);
+        if (!data.functionProfile->writeCollapsed(functionFile, data)) {
+            std::cerr << "Failed to write profile to " << functionFile << ".\n";
+        }
+    }
+    if (data.sampleProfile) {
+        std::cerr << '\n';
+        data.sampleProfile->writeTable(std::cerr, data);
+        if (!data.sampleProfile->writeCollapsed(sampleFile, data)) {
+            std::cerr << "Failed to write profile to " << sampleFile << ".\n";
+        }
+    }
+}
+
+static void writeHeapReport(GameData &data, const std::string &heapReportFile) {
+    if (!heapReportFile.empty() && !data.writeHeapReport(heapReportFile)) {
+        std::cerr << "Failed to write heap report to " << heapReportFile << ".\n";
+    }
+}
+
+static void writeProbeTrace(const GameData &data, const std::string &probeFile) {
+#ifdef RATVM_PROBES
+    if (!probeFile.empty() && !probeBuffer.writeChromeTrace(probeFile, data)) {
+        std::cerr << "Failed to write probe trace to " << probeFile << ".\n";
+    }
+#endif
+}
 
 int main(int argc, char *argv[]) {
     std::string gameFile;
+    std::string stateFile;
+    std::string replayFile;
+    std::string profileFile;
+    std::string functionProfileFile;
+    std::string sampleProfileFile;
+    std::string recordFile;
+    std::string traceFile;
+    std::string probeFile;
+    std::string heapReportFile;
+    bool hasSeed = false;
+    uint64_t seed = 0;
     bool doDump = false;
     bool doSilent = false;
     bool showDebug = false;
+    bool showHeapStats = false;
+    int exploreDepth = 0;
+    bool doServer = false;
+    int threadCount = std::thread::hardware_concurrency();
 
     for (int i = 1; i < argc; ++i) {
         if (strcmp(argv[i], "-h") == 0 || strcmp(argv[i], "-help") == 0) {
@@ -16,6 +79,31 @@ int main(int argc, char *argv[]) {
             std::cerr << "    -version   Display version data then quit.\n";
             std::cerr << "    -dump      Dump game data then quit.\n";
             std::cerr << "    -silent    Run initial game function then quit.\n";
+            std::cerr << "    -state F   Resume from state file F if it exists and save to it every turn.\n";
+            std::cerr << "    -replay F  Play inputs from script F without displaying the game then report timings.\n";
+            std::cerr << "    -explore N Try every option at each choice up to N choices deep then quit.\n";
+            std::cerr << "    -server    Host many sessions of the game, reading commands from standard input.\n";
+            std::cerr << "    -threads N Number of threads to use with -explore or -server.\n";
+            std::cerr << "    -profile F Count the opcodes run and the time spent on each, then write\n";
+            std::cerr << "               a report on exit and save it as JSON to file F.\n";
+            std::cerr << "    -profile-functions F\n";
+            std::cerr << "               Count the opcodes run, time taken, and items created by each\n";
+            std::cerr << "               function, then write a report on exit and save the call\n";
+            std::cerr << "               stacks to file F in collapsed stack format.\n";
+            std::cerr << "    -gc-stats  Display garbage collection and heap statistics on exit.\n";
+            std::cerr << "    -heap-report F\n";
+            std::cerr << "               Record where each new item is created and save the items still\n";
+            std::cerr << "               in use, grouped by where they were created, to file F each turn.\n";
+            std::cerr << "    -sample F  Sample the function calls in progress every millisecond, then\n";
+            std::cerr << "               write a report on exit and save the sampled call stacks to\n";
+            std::cerr << "               file F in collapsed stack format.\n";
+            std::cerr << "    -seed N    Seed the game's random numbers with N.\n";
+            std::cerr << "    -record F  Record the random seed, files used, and input to trace file F.\n";
+            std::cerr << "    -replay-trace F\n";
+            std::cerr << "               Play the session recorded in trace file F again exactly.\n";
+            std::cerr << "    -probe-trace F\n";
+            std::cerr << "               Save the VM activity seen by the probes to file F as Chrome\n";
+            std::cerr << "               trace events. Needs a runner built with make PROBES=1.\n";
             return 0;
         } else if (strcmp(argv[i], "-v") == 0 || strcmp(argv[i], "-version") == 0) {
             std::cerr << "Console Runner RatVM, V1.0\n";
@@ -26,6 +114,98 @@ int main(int argc, char *argv[]) {
             doSilent = true;
         } else if (strcmp(argv[i], "-debug") == 0) {
             showDebug = true;
+        } else if (strcmp(argv[i], "-gc-stats") == 0) {
+            showHeapStats = true;
+        } else if (strcmp(argv[i], "-state") == 0) {
+            ++i;
+            if (i >= argc) {
+                std::cerr << "-state requires name of state file.\n";
+                return 1;
+            }
+            stateFile = argv[i];
+        } else if (strcmp(argv[i], "-replay") == 0) {
+            ++i;
+            if (i >= argc) {
+                std::cerr << "-replay requires name of script file.\n";
+                return 1;
+            }
+            replayFile = argv[i];
+        } else if (strcmp(argv[i], "-profile") == 0) {
+            ++i;
+            if (i >= argc) {
+                std::cerr << "-profile requires name of profile file.\n";
+                return 1;
+            }
+            profileFile = argv[i];
+        } else if (strcmp(argv[i], "-profile-functions") == 0) {
+            ++i;
+            if (i >= argc) {
+                std::cerr << "-profile-functions requires name of profile file.\n";
+                return 1;
+            }
+            functionProfileFile = argv[i];
+        } else if (strcmp(argv[i], "-sample") == 0) {
+            ++i;
+            if (i >= argc) {
+                std::cerr << "-sample requires name of profile file.\n";
+                return 1;
+            }
+            sampleProfileFile = argv[i];
+        } else if (strcmp(argv[i], "-heap-report") == 0) {
+            ++i;
+            if (i >= argc) {
+                std::cerr << "-heap-report requires name of report file.\n";
+                return 1;
+            }
+            heapReportFile = argv[i];
+        } else if (strcmp(argv[i], "-seed") == 0) {
+            ++i;
+            char *end = nullptr;
+            if (i < argc) seed = strtoull(argv[i], &end, 10);
+            if (i >= argc || end == argv[i] || *end != 0) {
+                std::cerr << "-seed requires a number.\n";
+                return 1;
+            }
+            hasSeed = true;
+        } else if (strcmp(argv[i], "-record") == 0) {
+            ++i;
+            if (i >= argc) {
+                std::cerr << "-record requires name of trace file.\n";
+                return 1;
+            }
+            recordFile = argv[i];
+        } else if (strcmp(argv[i], "-replay-trace") == 0) {
+            ++i;
+            if (i >= argc) {
+                std::cerr << "-replay-trace requires name of trace file.\n";
+                return 1;
+            }
+            traceFile = argv[i];
+        } else if (strcmp(argv[i], "-probe-trace") == 0) {
+            ++i;
+            if (i >= argc) {
+                std::cerr << "-probe-trace requires name of trace file.\n";
+                return 1;
+            }
+#ifndef RATVM_PROBES
+            std::cerr << "-probe-trace requires a runner built with make PROBES=1.\n";
+            return 1;
+#endif
+            probeFile = argv[i];
+        } else if (strcmp(argv[i], "-explore") == 0) {
+            ++i;
+            if (i >= argc || (exploreDepth = strtol(argv[i], nullptr, 10)) <= 0) {
+                std::cerr << "-explore requires a positive maximum depth.\n";
+                return 1;
+            }
+        } else if (strcmp(argv[i], "-server") == 0) {
+            doServer = true;
+        } else if (strcmp(argv[i], "-threads") == 0) {
+            ++i;
+            if (i >= argc || (threadCount = strtol(argv[i], nullptr, 10)) <= 0) {
+                std::cerr << "-threads requires a positive number of threads.\n";
+                return 1;
+            }
         } else if (argv[i][0] == '-') {
             std::cerr << "Unrecognized option " << argv[i] << ".\n";
             return 1;
@@ -37,12 +217,60 @@ int main(int argc, char *argv[]) {
         }
     }
     if (gameFile.empty()) gameFile = "game.qvm";
+    bool doProfile = !profileFile.empty() || !functionProfileFile.empty()
+                  || !sampleProfileFile.empty() || !heapReportFile.empty();
+    if (doProfile && (exploreDepth > 0 || doServer)) {
+        std::cerr << "Profiling and heap reports cannot be used with -explore or -server.\n";
+        return 1;
+    }
+    if (!recordFile.empty() && !traceFile.empty()) {
+        std::cerr << "Only one of -record and -replay-trace may be used.\n";
+        return 1;
+    }
+    bool doTrace = !recordFile.empty() || !traceFile.empty();
+    if (doTrace && (exploreDepth > 0 || doServer || !replayFile.empty() || !stateFile.empty())) {
+        std::cerr << "Traces cannot be used with -explore, -server, -replay, or -state.\n";
+        return 1;
+    }
 
 
     GameData data;
     data.load(gameFile);
     if (!data.gameLoaded) return 1;
     data.showDebug = showDebug;
+    data.trackAllocations = !heapReportFile.empty();
+    std::unique_ptr<OpcodeProfile> opcodeProfile;
+    if (!profileFile.empty()) {
+        opcodeProfile.reset(new OpcodeProfile);
+        data.opcodeProfile = opcodeProfile.get();
+    }
+    std::unique_ptr<FunctionProfile> functionProfile;
+    if (!functionProfileFile.empty()) {
+        functionProfile.reset(new FunctionProfile);
+        data.functionProfile = functionProfile.get();
+    }
+    std::unique_ptr<SampleProfile> sampleProfile;
+    if (!sampleProfileFile.empty()) {
+        sampleProfile.reset(new SampleProfile);
+        data.sampleProfile = sampleProfile.get();
+    }
+    if (!hasSeed) {
+        std::random_device device;
+        seed = (static_cast<uint64_t>(device()) << 32) ^ device()
+             ^ std::chrono::steady_clock::now().time_since_epoch().count();
+    }
+    std::unique_ptr<Trace> trace;
+    if (doTrace) {
+        trace.reset(new Trace);
+        const std::string &gameId = data.getString(data.refGameid).text;
+        if (!recordFile.empty() && !trace->startRecording(recordFile, gameId, seed)) return 1;
+        if (!traceFile.empty()) {
+            if (!trace->startReplay(traceFile, gameId)) return 1;
+            seed = trace->getSeed();
+        }
+        data.trace = trace.get();
+    }
+    data.random.seed(seed);
 
     if (doDump) {
         data.dump();
@@ -53,8 +281,32 @@ int main(int argc, char *argv[]) {
         data.infoText[i] = "";
     }
     data.infoText[INFO_TITLE] = gameFile;
+    if (threadCount <= 0) threadCount = 1;
+    if (exploreDepth > 0) {
+        explore(data, exploreDepth, threadCount);
+        writeProbeTrace(data, probeFile);
+        return 0;
+    }
+    if (doServer) {
+        serve(data, threadCount);
+        writeProbeTrace(data, probeFile);
+        return 0;
+    }
+    if (!stateFile.empty()) {
+        std::ifstream stateCheck(stateFile);
+        if (stateCheck) {
+            stateCheck.close();
+            if (!data.loadState(stateFile)) {
+                std::cerr << "Starting new game instead.\n";
+            }
+        }
+    }
     try {
-        gameloop(data, doSilent);
+        if (!replayFile.empty()) {
+            if (!replay(data, replayFile)) return 1;
+        } else {
+            gameloop(data, doSilent, stateFile, heapReportFile);
+        }
     } catch (GameError &e) {
         std::cerr << "\n" << IO::setFG(IO::Red);
         std::cerr << "RUNTIME ERROR:";
@@ -66,7 +318,7 @@ int main(int argc, char *argv[]) {
         } else {
             for (int i = data.callStack.size() - 1; i >= 0 ; --i) {
                 const gtCallStack::Frame &frame = data.callStack[i];
-                FunctionDef &fdef = data.getFunction(frame.functionId);
+                const FunctionDef &fdef = data.getFunction(frame.functionId);
                 std::cerr << "    ";
                 if (fdef.srcName >= 0) {
                     std::cerr << data.getString(fdef.srcName).text;
@@ -95,8 +347,22 @@ int main(int argc, char *argv[]) {
                 std::cerr << '\n';
             }
         }
+        reportProfiles(data, profileFile, functionProfileFile, sampleProfileFile);
+        writeHeapReport(data, heapReportFile);
+        writeProbeTrace(data, probeFile);
+        if (showHeapStats) {
+            std::cerr << '\n';
+            data.heapStats.write(std::cerr);
+        }
         return 1;
     }
     std::cout << IO::normal();
+    reportProfiles(data, profileFile, functionProfileFile, sampleProfileFile);
+    writeHeapReport(data, heapReportFile);
+    writeProbeTrace(data, probeFile);
+    if (showHeapStats) {
+        std::cerr << '\n';
+        data.heapStats.write(std::cerr);
+    }
     return 0;
 }
\ No newline at end of file
@@ -0,0 +1,351 @@
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "bytestream.h"
+#include "gamedata.h"
+#include "probe.h"
+
+const uint32_t STATE_FILETYPE_ID = 0x53505254;
+const uint32_t STATE_VERSION = 1;
+
+// bytes taken by a value in a state file: its type, value, and self object
+const size_t VALUE_SIZE = 9;
+
+class StateReader {
+public:
+    StateReader(const std::vector<uint8_t> &data)
+    : data(data), pos(0)
+    { }
+
+    uint8_t read_8() {
+        need(1);
+        return data[pos++];
+    }
+    uint32_t read_32() {
+        need(4);
+        uint32_t value = data[pos] | (data[pos + 1] << 8)
+                       | (data[pos + 2] << 16) | (data[pos + 3] << 24);
+        pos += 4;
+        return value;
+    }
+    std::string read_str() {
+        uint32_t length = read_32();
+        need(length);
+        std::string text(reinterpret_cast<const char*>(&data[pos]), length);
+        pos += length;
+        return text;
+    }
+    Value read_value() {
+        Value value;
+        value.type = static_cast<Value::Type>(read_8());
+        value.value = read_32();
+        value.selfObj = read_32();
+        return value;
+    }
+    // the number of entries in a table, each taking at least entrySize
+    // bytes; checked against the data left so a corrupt count can't cause
+    // a huge allocation
+    uint32_t read_count(size_t entrySize) {
+        uint32_t count = read_32();
+        if (count > (data.size() - pos) / entrySize) {
+            throw GameError("Unexpected end of state data.");
+        }
+        return count;
+    }
+    bool atEnd() const {
+        return pos == data.size();
+    }
+private:
+    void need(size_t count) {
+        if (pos + count > data.size()) {
+            throw GameError("Unexpected end of state data.");
+        }
+    }
+
+    const std::vector<uint8_t> &data;
+    size_t pos;
+};
+
+static void write_str(ByteStream &out, const std::string &text) {
+    out.add_32(text.size());
+    for (char c : text) out.add_8(c);
+}
+
+static void write_value(ByteStream &out, const Value &value) {
+    out.add_8(value.type);
+    out.add_32(value.value);
+    out.add_32(value.selfObj);
+}
+
+static void write_item(ByteStream &out, const DataItem &item) {
+    out.add_32(item.ident);
+    out.add_8(item.isStatic ? 1 : 0);
+    out.add_32(item.srcFile);
+    out.add_32(item.srcLine);
+    out.add_32(item.srcName);
+}
+
+static void read_item(StateReader &in, DataItem &item) {
+    item.ident = in.read_32();
+    item.isStatic = in.read_8() != 0;
+    item.srcFile = in.read_32();
+    item.srcLine = in.read_32();
+    item.srcName = in.read_32();
+}
+
+
+bool GameData::saveState(const std::string &filename) {
+    PROBE_SCOPE("save state", 0);
+    ByteStream out;
+
+    out.add_32(STATE_FILETYPE_ID);
+    out.add_32(STATE_VERSION);
+    write_str(out, getString(refGameid).text);
+    out.add_32(refBuild);
+
+    out.add_32(nextString);
+    out.add_32(nextList);
+    out.add_32(nextMap);
+    out.add_32(nextObject);
+    out.add_8(static_cast<int>(optionType));
+    out.add_32(extraValue);
+    for (uint32_t word : random.state) out.add_32(word);
+    for (const std::string &text : infoText) write_str(out, text);
+    write_str(out, textBuffer);
+
+    out.add_32(strings.size());
+    for (const auto &def : strings) {
+        write_item(out, *def.second);
+        write_str(out, def.second->text);
+    }
+    out.add_32(lists.size());
+    for (const auto &def : lists) {
+        write_item(out, *def.second);
+        out.add_32(def.second->items.size());
+        for (const Value &value : def.second->items) write_value(out, value);
+    }
+    out.add_32(maps.size());
+    for (const auto &def : maps) {
+        write_item(out, *def.second);
+        out.add_32(def.second->rows.size());
+        for (const MapDef::Row &row : def.second->rows) {
+            write_value(out, row.key);
+            write_value(out, row.value);
+        }
+    }
+    out.add_32(objects.size());
+    for (const auto &def : objects) {
+        write_item(out, *def.second);
+        out.add_32(def.second->parentId);
+        out.add_32(def.second->childId);
+        out.add_32(def.second->siblingId);
+        out.add_32(def.second->properties.size());
+        for (const auto &property : def.second->properties) {
+            out.add_32(property.first);
+            write_value(out, property.second);
+        }
+    }
+
+    out.add_32(options.size());
+    for (const GameOption &option : options) {
+        out.add_32(option.strId);
+        write_value(out, option.value);
+        write_value(out, option.extra);
+        out.add_32(option.hotkey);
+    }
+
+    out.add_32(callStack.size());
+    for (int i = 0; i < callStack.size(); ++i) {
+        const gtCallStack::Frame &frame = callStack[i];
+        out.add_32(frame.functionId);
+        out.add_32(frame.IP);
+        out.add_32(frame.stack.argList.size());
+        for (const Value &value : frame.stack.argList) write_value(out, value);
+        out.add_32(frame.stack.mValues.size());
+        for (const Value &value : frame.stack.mValues) write_value(out, value);
+    }
+
+    // write to a temporary file first so a crash mid-write never destroys
+    // the last good state
+    const std::string tempName = filename + ".tmp";
+    std::ofstream outf(tempName, std::ios_base::binary);
+    if (!outf) {
+        std::cerr << "Could not write state file ~" << tempName << "~.\n";
+        return false;
+    }
+    out.write(outf);
+    outf.close();
+    if (!outf || std::rename(tempName.c_str(), filename.c_str()) != 0) {
+        std::cerr << "Failed to save state file ~" << filename << "~.\n";
+        return false;
+    }
+    return true;
+}
+
+bool GameData::loadState(const std::string &filename) {
+    PROBE_SCOPE("load state", 0);
+    std::ifstream inf(filename, std::ios_base::binary);
+    if (!inf) {
+        std::cerr << "Could not open state file ~" << filename << "~.\n";
+        return false;
+    }
+    inf.seekg(0, std::ios_base::end);
+    std::vector<uint8_t> data(static_cast<size_t>(inf.tellg()));
+    inf.seekg(0);
+    inf.read(reinterpret_cast<char*>(data.data()), data.size());
+    if (!inf) {
+        std::cerr << "Failed to read state file ~" << filename << "~.\n";
+        return false;
+    }
+
+    StateReader in(data);
+    try {
+        if (in.read_32() != STATE_FILETYPE_ID) {
+            std::cerr << '~' << filename << "~ is not a valid state file.\n";
+            return false;
+        }
+        uint32_t version = in.read_32();
+        if (version != STATE_VERSION) {
+            std::cerr << '~' << filename << "~ has state version " << version;
+            std::cerr << ", but only version " << STATE_VERSION << " is supported.\n";
+            return false;
+        }
+        std::string gameId = in.read_str();
+        uint32_t build = in.read_32();
+        if (gameId != getString(refGameid).text || build != static_cast<uint32_t>(refBuild)) {
+            std::cerr << '~' << filename << "~ was saved by a different game or build.\n";
+            return false;
+        }
+
+        std::map<int, std::shared_ptr<StringDef>> newStrings;
+        std::map<int, std::shared_ptr<ListDef>> newLists;
+        std::map<int, std::shared_ptr<MapDef>> newMaps;
+        std::map<int, std::shared_ptr<ObjectDef>> newObjects;
+        std::vector<GameOption> newOptions;
+        gtCallStack newCallStack;
+        unsigned newNextString = in.read_32();
+        unsigned newNextList = in.read_32();
+        unsigned newNextMap = in.read_32();
+        unsigned newNextObject = in.read_32();
+        OptionType newOptionType = static_cast<OptionType>(in.read_8());
+        int newExtraValue = in.read_32();
+        RandomGenerator newRandom;
+        for (uint32_t &word : newRandom.state) word = in.read_32();
+        if (!newRandom.isValid()) throw GameError("Invalid random number state in state file.");
+        std::array<std::string, INFO_COUNT> newInfoText;
+        for (std::string &text : newInfoText) text = in.read_str();
+        std::string newTextBuffer = in.read_str();
+
+        unsigned count = in.read_32();
+        for (unsigned i = 0; i < count; ++i) {
+            std::shared_ptr<StringDef> def = std::make_shared<StringDef>();
+            def->owner = mGeneration;
+            read_item(in, *def);
+            if (def->ident >= newNextString || !newStrings.insert(std::make_pair(def->ident, def)).second) {
+                throw GameError("Invalid string number in state file.");
+            }
+            def->text = in.read_str();
+        }
+        count = in.read_32();
+        for (unsigned i = 0; i < count; ++i) {
+            std::shared_ptr<ListDef> def = std::make_shared<ListDef>();
+            def->owner = mGeneration;
+            read_item(in, *def);
+            if (def->ident >= newNextList || !newLists.insert(std::make_pair(def->ident, def)).second) {
+                throw GameError("Invalid list number in state file.");
+            }
+            unsigned itemCount = in.read_count(VALUE_SIZE);
+            def->items.reserve(itemCount);
+            for (unsigned j = 0; j < itemCount; ++j) {
+                def->items.push_back(in.read_value());
+            }
+        }
+        count = in.read_32();
+        for (unsigned i = 0; i < count; ++i) {
+            std::shared_ptr<MapDef> def = std::make_shared<MapDef>();
+            def->owner = mGeneration;
+            read_item(in, *def);
+            if (def->ident >= newNextMap || !newMaps.insert(std::make_pair(def->ident, def)).second) {
+                throw GameError("Invalid map number in state file.");
+            }
+            unsigned rowCount = in.read_count(VALUE_SIZE * 2);
+            def->rows.reserve(rowCount);
+            for (unsigned j = 0; j < rowCount; ++j) {
+                Value key = in.read_value();
+                Value value = in.read_value();
+                def->rows.push_back(MapDef::Row{key, value});
+            }
+        }
+        count = in.read_32();
+        for (unsigned i = 0; i < count; ++i) {
+            std::shared_ptr<ObjectDef> def = std::make_shared<ObjectDef>();
+            def->owner = mGeneration;
+            read_item(in, *def);
+            if (def->ident >= newNextObject || !newObjects.insert(std::make_pair(def->ident, def)).second) {
+                throw GameError("Invalid object number in state file.");
+            }
+            def->parentId = in.read_32();
+            def->childId = in.read_32();
+            def->siblingId = in.read_32();
+            unsigned propertyCount = in.read_count(4 + VALUE_SIZE);
+            for (unsigned j = 0; j < propertyCount; ++j) {
+                unsigned propId = in.read_32();
+                def->properties.insert(std::make_pair(propId, in.read_value()));
+            }
+        }
+
+        count = in.read_32();
+        for (unsigned i = 0; i < count; ++i) {
+            GameOption option;
+            option.strId = in.read_32();
+            option.value = in.read_value();
+            option.extra = in.read_value();
+            option.hotkey = in.read_32();
+            newOptions.push_back(option);
+        }
+
+        count = in.read_32();
+        for (unsigned i = 0; i < count; ++i) {
+            unsigned functionId = in.read_32();
+            newCallStack.create(getFunction(functionId), functionId);
+            gtCallStack::Frame &frame = newCallStack.callTop();
+            frame.IP = in.read_32();
+            unsigned argCount = in.read_count(VALUE_SIZE);
+            for (unsigned j = 0; j < argCount; ++j) {
+                frame.stack.argList.push_back(in.read_value());
+            }
+            unsigned stackSize = in.read_count(VALUE_SIZE);
+            for (unsigned j = 0; j < stackSize; ++j) {
+                frame.stack.mValues.push_back(in.read_value());
+            }
+        }
+        if (!in.atEnd()) {
+            throw GameError("Extra data found at end of state file.");
+        }
+
+        nextString = newNextString;
+        nextList = newNextList;
+        nextMap = newNextMap;
+        nextObject = newNextObject;
+        optionType = newOptionType;
+        extraValue = newExtraValue;
+        random = newRandom;
+        infoText = newInfoText;
+        textBuffer = newTextBuffer;
+
+        strings.swap(newStrings);
+        lists.swap(newLists);
+        maps.swap(newMaps);
+        objects.swap(newObjects);
+        options.swap(newOptions);
+        callStack.swap(newCallStack);
+    } catch (const GameError &e) {
+        std::cerr << "Failed to load state file ~" << filename << "~: " << e.what() << '\n';
+        return false;
+    }
+    return true;
+}
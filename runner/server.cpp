@@ -0,0 +1,211 @@
+#include <deque>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <sstream>
+#include <string>
+#include "gamedata.h"
+#include "formatter.h"
+#include "threadpool.h"
+
+struct Session {
+    Session(const std::string &name, GameData &&gamedata)
+    : name(name), gamedata(std::move(gamedata)), started(false),
+      finished(false), scheduled(false), garbageCounter(0)
+    { }
+
+    const std::string name;
+    GameData gamedata;
+    bool started, finished;
+
+    // input waiting to be processed; only one pool task works through a
+    // session's input at a time so each session runs in order
+    std::mutex mutex;
+    std::deque<std::string> input;
+    bool scheduled;
+
+    int garbageCounter;
+};
+
+class Server {
+public:
+    Server(GameData &story, int threadCount)
+    : story(story), pool(threadCount)
+    { }
+
+    void run(std::istream &in);
+
+private:
+    void send(std::shared_ptr<Session> session, const std::string &inputText);
+    void process(std::shared_ptr<Session> session);
+    bool step(Session &session, const std::string &inputText);
+    void reply(const std::string &name, const std::string &type, const std::string &text);
+
+    GameData &story;
+    std::map<std::string, std::shared_ptr<Session>> sessions;
+    std::mutex outputMutex;
+    // declared last so the worker threads stop before anything they use
+    ThreadPool pool;
+};
+
+// Replies are kept to a single line, so escape any line breaks in the text.
+static std::string escapeText(const std::string &text) {
+    std::string result;
+    for (char c : text) {
+        switch(c) {
+            case '\\':  result += "\\\\"; break;
+            case '\n':  result += "\\n";  break;
+            case '\r':  break;
+            default:    result += c;
+        }
+    }
+    return result;
+}
+
+void Server::reply(const std::string &name, const std::string &type, const std::string &text) {
+    std::string line = name + ' ' + type + ' ' + escapeText(text) + '\n';
+    std::lock_guard<std::mutex> lock(outputMutex);
+    std::cout << line << std::flush;
+}
+
+void Server::run(std::istream &in) {
+    std::string line;
+    while (std::getline(in, line)) {
+        std::stringstream ss(line);
+        std::string command, name;
+        ss >> command >> name;
+        if (command.empty()) continue;
+        if (command == "quit") break;
+        if (name.empty()) {
+            reply("-", "error", "Command " + command + " requires a session name.");
+            continue;
+        }
+
+        auto iter = sessions.find(name);
+        if (command == "new") {
+            if (iter != sessions.end()) {
+                reply(name, "error", "Session already exists.");
+                continue;
+            }
+            std::shared_ptr<Session> session = std::make_shared<Session>(name, story.fork());
+            // each session gets its own random numbers, all still decided
+            // by the seed the server was started with
+            session->gamedata.random.seed(story.random.next64());
+            sessions.insert(std::make_pair(name, session));
+            send(session, "");
+        } else if (command == "in") {
+            if (iter == sessions.end()) {
+                reply(name, "error", "No such session.");
+                continue;
+            }
+            std::string inputText;
+            if (ss.peek() == ' ') ss.get();
+            std::getline(ss, inputText);
+            send(iter->second, inputText);
+        } else if (command == "end") {
+            // any input already sent is still processed since the pool
+            // tasks keep their own reference to the session
+            if (iter != sessions.end()) sessions.erase(iter);
+        } else {
+            reply(name, "error", "Unknown command " + command + ".");
+        }
+    }
+    pool.wait();
+}
+
+void Server::send(std::shared_ptr<Session> session, const std::string &inputText) {
+    std::lock_guard<std::mutex> lock(session->mutex);
+    session->input.push_back(inputText);
+    if (!session->scheduled) {
+        session->scheduled = true;
+        pool.submit([this, session]{ process(session); });
+    }
+}
+
+void Server::process(std::shared_ptr<Session> session) {
+    while (1) {
+        std::string inputText;
+        {
+            std::lock_guard<std::mutex> lock(session->mutex);
+            if (session->input.empty()) {
+                session->scheduled = false;
+                return;
+            }
+            inputText = std::move(session->input.front());
+            session->input.pop_front();
+        }
+        if (!step(*session, inputText)) {
+            session->finished = true;
+        }
+    }
+}
+
+// Run one turn of a session. Returns false once the session can't continue.
+bool Server::step(Session &session, const std::string &inputText) {
+    GameData &gamedata = session.gamedata;
+    Value nextValue;
+    bool hasValue = false;
+    if (session.finished) {
+        reply(session.name, "error", "Session has ended.");
+        return false;
+    } else if (!session.started) {
+        startGame(gamedata);
+        session.started = true;
+    } else {
+        if (!handleInput(gamedata, inputText, nextValue)) {
+            reply(session.name, "invalid", inputText);
+            return true;
+        }
+        hasValue = true;
+    }
+
+    ++session.garbageCounter;
+    if (session.garbageCounter >= GARBAGE_FREQUENCY) {
+        gamedata.collectGarbage();
+        session.garbageCounter = 0;
+    }
+    gamedata.startTurn();
+    try {
+        gamedata.resume(hasValue, nextValue);
+    } catch (GameError &e) {
+        reply(session.name, "error", e.what());
+        return false;
+    }
+
+    std::string text = formatText(gamedata.textBuffer).finalResult;
+    switch(gamedata.optionType) {
+        case OptionType::EndOfProgram:
+            reply(session.name, "end", text);
+            return false;
+        case OptionType::Key:
+            reply(session.name, "key", text);
+            break;
+        case OptionType::Line:
+            reply(session.name, "line", text);
+            break;
+        case OptionType::Choice:
+            assignHotkeys(gamedata);
+            for (const GameOption &option : gamedata.options) {
+                text += '\n';
+                if (option.hotkey > 0) {
+                    text += static_cast<char>(option.hotkey);
+                } else {
+                    text += std::to_string(-option.hotkey);
+                }
+                text += ") " + gamedata.getString(option.strId).text;
+            }
+            reply(session.name, "choice", text);
+            break;
+        default:
+            reply(session.name, "error", "Unknown option type "
+                                         + std::to_string(static_cast<int>(gamedata.optionType)));
+            return false;
+    }
+    return true;
+}
+
+void serve(GameData &gamedata, int threadCount) {
+    Server server(gamedata, threadCount);
+    server.run(std::cin);
+}
@@ -21,6 +21,13 @@ void gtStack::setArg(unsigned index, const Value &newValue) {
     argList[index] = newValue;
 }
 
+const Value& gtStack::getArg(unsigned index) const {
+    if (index >= argList.size()) {
+        throw GameError("Tried to get illegal local number " + std::to_string(index) + ".");
+    }
+    return argList[index];
+}
+
 Value gtStack::peek(int index) const {
     if (index < 0) throw GameError("Tried to peek at negative stack index.");
     if (index >= static_cast<int>(mValues.size())) {
@@ -87,7 +94,7 @@ int gtCallStack::size() const {
     return mFrames.size();
 }
 
-const gtCallStack::Frame& gtCallStack::operator[](int index) {
+const gtCallStack::Frame& gtCallStack::operator[](int index) const {
     if (index < 0 || index >= static_cast<int>(mFrames.size())) {
         throw GameError("Tried to read non-exstant stack frame.");
     }
@@ -11,6 +11,7 @@ class gtStack {
 public:
     void setArgs(const std::vector<Value> &rawArgs, int argCount, int localCount);
     void setArg(unsigned index, const Value &newValue);
+    const Value& getArg(unsigned index) const;
     int argCount() const {
         return static_cast<int>(argList.size());
     }
@@ -72,11 +73,14 @@ public:
 
     void create(const FunctionDef &funcDef, unsigned functionId);
     void drop();
+    void swap(gtCallStack &other) {
+        mFrames.swap(other.mFrames);
+    }
     gtStack& getStack();
 
     bool isEmpty() const;
     int size() const;
-    const Frame& operator[](int index);
+    const Frame& operator[](int index) const;
 private:
     std::vector<Frame> mFrames;
 };
@@ -0,0 +1,214 @@
+#include <iostream>
+#include <iterator>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "gamedata.h"
+#include "trace.h"
+
+const uint32_t TRACE_FILETYPE_ID = 0x43525452;
+const uint32_t TRACE_VERSION = 1;
+
+Trace::Trace()
+: replaying(false), seed(0), pos(0)
+{ }
+
+Trace::~Trace() {
+    if (out.is_open()) out.flush();
+}
+
+bool Trace::startRecording(const std::string &filename, const std::string &gameId, uint64_t seed) {
+    out.open(filename, std::ios::binary);
+    if (!out) {
+        std::cerr << "Could not create trace file ~" << filename << "~.\n";
+        return false;
+    }
+    for (int i = 0; i < 32; i += 8) out.put(static_cast<char>(TRACE_FILETYPE_ID >> i));
+    for (int i = 0; i < 32; i += 8) out.put(static_cast<char>(TRACE_VERSION >> i));
+    writeString(gameId);
+    writeNumber(seed);
+    this->seed = seed;
+    out.flush();
+    return true;
+}
+
+bool Trace::startReplay(const std::string &filename, const std::string &gameId) {
+    std::ifstream inf(filename, std::ios::binary);
+    if (!inf) {
+        std::cerr << "Could not open trace file ~" << filename << "~.\n";
+        return false;
+    }
+    data.assign(std::istreambuf_iterator<char>(inf), std::istreambuf_iterator<char>());
+    replaying = true;
+    pos = 0;
+
+    uint32_t fileType = 0, version = 0;
+    if (data.size() >= 8) {
+        for (int i = 0; i < 4; ++i) fileType |= static_cast<uint32_t>(data[pos++]) << (i * 8);
+        for (int i = 0; i < 4; ++i) version |= static_cast<uint32_t>(data[pos++]) << (i * 8);
+    }
+    if (fileType != TRACE_FILETYPE_ID) {
+        std::cerr << filename << " is not a trace file.\n";
+        return false;
+    }
+    if (version != TRACE_VERSION) {
+        std::cerr << filename << " is from an unsupported version of the runner.\n";
+        return false;
+    }
+    try {
+        if (readString() != gameId) {
+            std::cerr << filename << " was recorded with a different game.\n";
+            return false;
+        }
+        seed = readNumber();
+    } catch (GameError &e) {
+        std::cerr << filename << ": " << e.what() << '\n';
+        return false;
+    }
+    return true;
+}
+
+void Trace::fileList(FileList &files) {
+    if (replaying) {
+        expect(FileListRead);
+        // each file's id, name, date, and game id take at least a byte each
+        files.resize(readCount(4));
+        for (FileRecord &file : files) {
+            file.fileId = readSigned();
+            file.name = readString();
+            file.date = readSigned();
+            file.gameId = readString();
+        }
+        return;
+    }
+    write(FileListRead);
+    writeNumber(files.size());
+    for (const FileRecord &file : files) {
+        writeSigned(file.fileId);
+        writeString(file.name);
+        writeSigned(file.date);
+        writeString(file.gameId);
+    }
+}
+
+bool Trace::fileData(bool found, std::vector<int> &values) {
+    if (replaying) {
+        expect(FileDataRead);
+        found = readNumber() != 0;
+        values.resize(readCount(1));
+        for (int &value : values) value = readSigned();
+        return found;
+    }
+    write(FileDataRead);
+    writeNumber(found ? 1 : 0);
+    writeNumber(values.size());
+    for (int value : values) writeSigned(value);
+    return found;
+}
+
+bool Trace::fileResult(bool result) {
+    if (replaying) {
+        expect(FileChanged);
+        return readNumber() != 0;
+    }
+    write(FileChanged);
+    writeNumber(result ? 1 : 0);
+    return result;
+}
+
+bool Trace::input(std::string &text) {
+    if (replaying) {
+        if (atEnd()) return false;
+        expect(PlayerInput);
+        text = readString();
+        return true;
+    }
+    write(PlayerInput);
+    writeString(text);
+    // everything up to the player's latest input survives a crash
+    out.flush();
+    return true;
+}
+
+const char* Trace::eventName(int event) {
+    switch(event) {
+        case FileListRead:  return "the list of files";
+        case FileDataRead:  return "the contents of a file";
+        case FileChanged:   return "a change to a file";
+        case PlayerInput:   return "player input";
+        default:            return "an unknown event";
+    }
+}
+
+// the game asked for something other than what was recorded next, so it
+// has behaved differently from when the trace was recorded
+void Trace::expect(Event event) {
+    if (atEnd()) {
+        std::stringstream ss;
+        ss << "Trace ended when the game asked for " << eventName(event) << '.';
+        throw GameError(ss.str());
+    }
+    if (data[pos] != event) {
+        std::stringstream ss;
+        ss << "Game asked for " << eventName(event) << " but the trace has ";
+        ss << eventName(data[pos]) << " next; the game has not behaved as it did when recorded.";
+        throw GameError(ss.str());
+    }
+    ++pos;
+}
+
+// numbers are written seven bits at a time, lowest first, with the high bit
+// set on every byte but the last; signed numbers are first zigzag encoded
+// so small negative numbers are also short
+void Trace::writeNumber(uint64_t value) {
+    while (value >= 0x80) {
+        out.put(static_cast<char>(value | 0x80));
+        value >>= 7;
+    }
+    out.put(static_cast<char>(value));
+}
+
+void Trace::writeSigned(int64_t value) {
+    writeNumber((static_cast<uint64_t>(value) << 1) ^ static_cast<uint64_t>(value >> 63));
+}
+
+void Trace::writeString(const std::string &text) {
+    writeNumber(text.size());
+    out.write(text.c_str(), text.size());
+}
+
+uint64_t Trace::readNumber() {
+    uint64_t value = 0;
+    for (int shift = 0; shift < 64; shift += 7) {
+        if (atEnd()) throw GameError("Unexpected end of trace data.");
+        uint8_t byte = data[pos++];
+        value |= static_cast<uint64_t>(byte & 0x7F) << shift;
+        if ((byte & 0x80) == 0) return value;
+    }
+    throw GameError("Corrupt number in trace data.");
+}
+
+// the number of entries in a table, each taking at least entrySize bytes;
+// checked against the data left so a corrupt count can't cause a huge
+// allocation
+uint64_t Trace::readCount(size_t entrySize) {
+    uint64_t count = readNumber();
+    if (count > (data.size() - pos) / entrySize) {
+        throw GameError("Unexpected end of trace data.");
+    }
+    return count;
+}
+
+int64_t Trace::readSigned() {
+    uint64_t value = readNumber();
+    return static_cast<int64_t>(value >> 1) ^ -static_cast<int64_t>(value & 1);
+}
+
+std::string Trace::readString() {
+    uint64_t length = readNumber();
+    if (length > data.size() - pos) throw GameError("Unexpected end of trace data.");
+    std::string text(reinterpret_cast<const char*>(&data[pos]), length);
+    pos += length;
+    return text;
+}
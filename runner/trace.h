@@ -0,0 +1,78 @@
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <cstdint>
+#include <fstream>
+#include <string>
+#include <vector>
+
+struct FileRecord;
+typedef std::vector<FileRecord> FileList;
+
+// A compact record of everything from outside the VM that affected a game
+// session: the seed of its random numbers, the files the game read or
+// changed, and the player's input. Nothing else a game does depends on the
+// outside world, so replaying a trace runs the session again exactly as it
+// first ran, down to the ids of the items it created. Recording only appends
+// a few bytes for each file used and line of input, so it can be left on
+// during normal play.
+//
+// Each function takes the value produced by the real source when
+// recording; when replaying, the value is replaced by the one recorded and
+// the caller should not touch the real source at all.
+class Trace {
+public:
+    Trace();
+    ~Trace();
+
+    // returns false, after reporting why, if the trace can't be used
+    bool startRecording(const std::string &filename, const std::string &gameId, uint64_t seed);
+    bool startReplay(const std::string &filename, const std::string &gameId);
+
+    bool isReplaying() const {
+        return replaying;
+    }
+    // the seed the game's random numbers were generated from
+    uint64_t getSeed() const {
+        return seed;
+    }
+    // true if every event in a replayed trace has been used
+    bool atEnd() const {
+        return pos == data.size();
+    }
+
+    void fileList(FileList &files);
+    bool fileData(bool found, std::vector<int> &values);
+    bool fileResult(bool result);
+    // returns false once a replayed trace has no more input
+    bool input(std::string &text);
+
+private:
+    enum Event : uint8_t {
+        FileListRead = 1,
+        FileDataRead,
+        FileChanged,
+        PlayerInput,
+    };
+
+    static const char* eventName(int event);
+    void expect(Event event);
+    void write(Event event) {
+        out.put(static_cast<char>(event));
+    }
+    void writeNumber(uint64_t value);
+    void writeSigned(int64_t value);
+    void writeString(const std::string &text);
+    uint64_t readNumber();
+    uint64_t readCount(size_t entrySize);
+    int64_t readSigned();
+    std::string readString();
+
+    bool replaying;
+    uint64_t seed;
+    std::ofstream out;
+    std::vector<uint8_t> data;
+    size_t pos;
+};
+
+#endif